@@ -1,20 +1,37 @@
+#include "chunkpack.h"
+#include "esinput.h"
 #include "smartchunk.h"
 #include "splitter.h"
 #include "stitcher.h"
+#include "y4m.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <libavformat/avformat.h>
 
+// Audio-only sources: enough for Opus' recommended 80 ms pre-roll and a
+// few AAC/MP3 frames of encoder warm-up
+#define DEFAULT_AUDIO_PREROLL 0.1
+
+// Renditions of one ladder are usually encoded with the same GOP
+// structure; this absorbs timestamp rounding between encoders
+#define DEFAULT_ALIGN_TOL 0.1
+#define MAX_RENDITIONS 16
+
+#define MAX_APPENDED 256
+
 typedef struct
 {
   const char *input;
   const char *chunks_dir;
   const char *final_out;
   const char *plan_json;
+  const char *plan_ndjson;
   double target;
   double min_dur;
   double max_dur;
@@ -23,9 +40,22 @@ typedef struct
   int max_chunks;
   int avoid_tiny_last;
   int frag_output;
+  int pack_output;
+  int cmaf_output;
+  const char *store_dir;
+  int fused;
+  int follow;
+  double follow_idle;
   const char *force_format;
   int skip_split;
   int skip_stitch;
+  const char *es_chunk_ext;
+  int package;
+  double segment_dur;
+  int fps_num;
+  int fps_den;
+  es_format es_input; // input is a raw elementary stream
+  int y4m_input;      // input is an uncompressed Y4M master
 
   // Smart chunking options
   int enable_smart;
@@ -33,6 +63,26 @@ typedef struct
   int enable_complexity;
   double scene_threshold;
   double complexity_weight;
+  int content_defined;
+  double grid_dur;
+  double grid_tol;
+  int64_t target_bytes;
+  double bytes_weight;
+  int nodes;        // two-level plan: macro chunks per node...
+  int node_workers; // ...each cut again for this many local workers
+  int keyframes_only;
+  int native_ts;
+  double sample_stride;
+  int sample_burst;
+  double audio_preroll; // <0: automatic (on for audio-only inputs)
+  const char *renditions[MAX_RENDITIONS]; // planned together with input
+  int rendition_count;
+  double align_tol;
+  const char *appended[MAX_APPENDED]; // files continuing input's timeline
+  int appended_count;
+  double clip_from; // --from/--to: only this range of the input
+  double clip_to;   // 0 = to the end
+  const char *edl;  // extract the ranges listed here instead of chunking
   int verbose;
 } cli_config;
 
@@ -43,12 +93,16 @@ static void cli_defaults(cli_config *cfg)
   cfg->avoid_tiny_last = 1;
   cfg->scene_threshold = 0.35;
   cfg->complexity_weight = 0.3;
+  cfg->audio_preroll = -1.0;
+  cfg->align_tol = DEFAULT_ALIGN_TOL;
+  cfg->bytes_weight = -1.0;
 }
 
 static void print_usage(const char *prog)
 {
   fprintf(stderr,
           "Usage: %s [options] <input> <chunks_dir> [final_output]\n"
+          "  final_output may be '-' to stream fragmented MP4/MKV/TS to stdout\n"
           "\n"
           "Basic Options:\n"
           "  --target <sec>         Target chunk duration (default 60)\n"
@@ -61,8 +115,28 @@ static void print_usage(const char *prog)
           "  --no-split             Skip chunk extraction (stitch only)\n"
           "  --no-stitch            Skip stitching\n"
           "  --frag                 Enable fragmented MP4 outputs\n"
+          "  --pack                 Write/read chunks in <chunks_dir>/chunks.pack\n"
+          "  --cmaf-chunks          Shared init.mp4 + media-only chunk_NNNN.m4s\n"
+          "  --fused                Probe, plan and split in one pass over the input\n"
+          "  --follow               Input is a growing TS/fMP4 recording (implies --fused)\n"
+          "  --follow-idle <sec>    End a followed input after this long without growth (default 10)\n"
+          "  --store <dir>          Content-addressed chunk store; link chunks already in it\n"
           "  --force-format <fmt>   Force muxer (mp4/mov/matroska/...)\n"
           "  --plan-json <path>     Write plan as JSON array\n"
+          "  --plan-ndjson <path>   Stream chunks as NDJSON lines while probing ('-' = stdout)\n"
+          "  --es-chunks <ext>      Stitch raw ES chunks (264/hevc/ivf/obu)\n"
+          "  --fps <num[/den]>      Frame rate for raw ES inputs and ES chunk timestamps\n"
+          "  --package <kind>       Stitch straight to hls/dash/cmaf segments\n"
+          "  --segment-dur <sec>    Packaged segment duration (default 6)\n"
+          "  --audio-preroll <sec>  Audio-only: overlap copied ahead of each chunk and\n"
+          "                         trimmed at stitch (default 0.1 for audio-only inputs)\n"
+          "  --rendition <path>     Another rendition to cut at the same points (repeatable)\n"
+          "  --align-tol <sec>      Keyframe match tolerance across renditions (default 0.1)\n"
+          "  --append <path>        Next file of a multi-file program (repeatable, in order)\n"
+          "  --from <sec>           Only probe, plan and split the input from here...\n"
+          "  --to <sec>             ...up to here; video to the next keyframe (default: the end)\n"
+          "  --edl <file>           Extract the listed ranges (\"start end\" per line) in one\n"
+          "                         pass: range_NNNN.mp4, or joined into final_output\n"
           "\n"
           "Smart Chunking Options:\n"
           "  --smart                Enable all smart chunking features\n"
@@ -70,10 +144,54 @@ static void print_usage(const char *prog)
           "  --complexity           Enable complexity-based adaptation\n"
           "  --scene-threshold <n>  Scene detection sensitivity 0.0-1.0 (default 0.35)\n"
           "  --complexity-weight <n> Complexity weighting 0.0-1.0 (default 0.3)\n"
+          "  --content-defined      Content-defined cuts that survive edits (cache-stable)\n"
+          "  --grid <sec>           Cut only on multiples of the packager segment duration\n"
+          "  --grid-tol <sec>       How far a keyframe may be off the grid (default 0.05)\n"
+          "  --target-bytes <n>     Target chunk size in bytes (K/M/G suffixes)\n"
+          "  --bytes-weight <w>     Size vs. duration in the target 0.0-1.0 (default 1 = size only)\n"
+          "  --nodes <n>            Two-level plan: balanced macro chunks for n nodes...\n"
+          "  --node-workers <n>     ...each cut into chunks for n local workers (default 1)\n"
+          "  --keyframes-only       Probe keeps one entry per GOP (memory ~ keyframe count)\n"
+          "  --native-ts            Probe MPEG-TS inputs with the built-in packet scanner\n"
+          "  --sample-probe <sec>   Sample packet sizes every <sec> s instead of reading all\n"
+          "  --sample-burst <n>     Minimum frames per sample, rounded up to whole GOPs (default 30)\n"
           "  --verbose              Show detailed chunk quality metrics\n",
           prog);
 }
 
+// Byte count with an optional binary K/M/G suffix
+static int parse_size(const char *s, int64_t *out)
+{
+  char *end = NULL;
+  double v = strtod(s, &end);
+  if (end == s || v <= 0.0)
+    return -1;
+  switch (*end)
+  {
+  case 'k':
+  case 'K':
+    v *= 1024.0;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    v *= 1024.0 * 1024.0;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    v *= 1024.0 * 1024.0 * 1024.0;
+    end++;
+    break;
+  }
+  if (*end == 'B' || *end == 'b')
+    end++;
+  if (*end != '\0')
+    return -1;
+  *out = (int64_t)v;
+  return 0;
+}
+
 static int parse_args(int argc, char **argv, cli_config *cfg)
 {
   cli_defaults(cfg);
@@ -113,6 +231,31 @@ static int parse_args(int argc, char **argv, cli_config *cfg)
     {
       cfg->frag_output = 1;
     }
+    else if (!strcmp(arg, "--pack"))
+    {
+      cfg->pack_output = 1;
+    }
+    else if (!strcmp(arg, "--cmaf-chunks"))
+    {
+      cfg->cmaf_output = 1;
+    }
+    else if (!strcmp(arg, "--store") && i + 1 < argc)
+    {
+      cfg->store_dir = argv[++i];
+    }
+    else if (!strcmp(arg, "--fused"))
+    {
+      cfg->fused = 1;
+    }
+    else if (!strcmp(arg, "--follow"))
+    {
+      cfg->follow = 1;
+      cfg->fused = 1;
+    }
+    else if (!strcmp(arg, "--follow-idle") && i + 1 < argc)
+    {
+      cfg->follow_idle = atof(argv[++i]);
+    }
     else if (!strcmp(arg, "--force-format") && i + 1 < argc)
     {
       cfg->force_format = argv[++i];
@@ -121,6 +264,43 @@ static int parse_args(int argc, char **argv, cli_config *cfg)
     {
       cfg->plan_json = argv[++i];
     }
+    else if (!strcmp(arg, "--plan-ndjson") && i + 1 < argc)
+    {
+      cfg->plan_ndjson = argv[++i];
+    }
+    else if (!strcmp(arg, "--es-chunks") && i + 1 < argc)
+    {
+      cfg->es_chunk_ext = argv[++i];
+    }
+    else if (!strcmp(arg, "--fps") && i + 1 < argc)
+    {
+      cfg->fps_den = 1;
+      if (sscanf(argv[++i], "%d/%d", &cfg->fps_num, &cfg->fps_den) < 1 ||
+          cfg->fps_num <= 0 || cfg->fps_den <= 0)
+      {
+        fprintf(stderr, "Invalid frame rate: %s\n", argv[i]);
+        return -1;
+      }
+    }
+    else if (!strcmp(arg, "--package") && i + 1 < argc)
+    {
+      const char *kind = argv[++i];
+      if (!strcmp(kind, "hls"))
+        cfg->package = STITCH_PACKAGE_HLS;
+      else if (!strcmp(kind, "dash"))
+        cfg->package = STITCH_PACKAGE_DASH;
+      else if (!strcmp(kind, "cmaf"))
+        cfg->package = STITCH_PACKAGE_CMAF;
+      else
+      {
+        fprintf(stderr, "Unknown package kind: %s\n", kind);
+        return -1;
+      }
+    }
+    else if (!strcmp(arg, "--segment-dur") && i + 1 < argc)
+    {
+      cfg->segment_dur = atof(argv[++i]);
+    }
     else if (!strcmp(arg, "--no-split"))
     {
       cfg->skip_split = 1;
@@ -151,11 +331,102 @@ static int parse_args(int argc, char **argv, cli_config *cfg)
     {
       cfg->complexity_weight = atof(argv[++i]);
     }
+    else if (!strcmp(arg, "--content-defined"))
+    {
+      cfg->content_defined = 1;
+    }
+    else if (!strcmp(arg, "--target-bytes") && i + 1 < argc)
+    {
+      if (parse_size(argv[++i], &cfg->target_bytes) < 0)
+      {
+        fprintf(stderr, "Invalid size: %s\n", argv[i]);
+        return -1;
+      }
+    }
+    else if (!strcmp(arg, "--bytes-weight") && i + 1 < argc)
+    {
+      cfg->bytes_weight = atof(argv[++i]);
+      if (!(cfg->bytes_weight >= 0.0 && cfg->bytes_weight <= 1.0))
+      {
+        fprintf(stderr, "--bytes-weight must be between 0 and 1.\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(arg, "--nodes") && i + 1 < argc)
+    {
+      cfg->nodes = atoi(argv[++i]);
+    }
+    else if (!strcmp(arg, "--node-workers") && i + 1 < argc)
+    {
+      cfg->node_workers = atoi(argv[++i]);
+    }
+    else if (!strcmp(arg, "--grid") && i + 1 < argc)
+    {
+      cfg->grid_dur = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--grid-tol") && i + 1 < argc)
+    {
+      cfg->grid_tol = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--native-ts"))
+    {
+      cfg->native_ts = 1;
+    }
+    else if (!strcmp(arg, "--keyframes-only"))
+    {
+      cfg->keyframes_only = 1;
+    }
+    else if (!strcmp(arg, "--sample-probe") && i + 1 < argc)
+    {
+      cfg->sample_stride = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--sample-burst") && i + 1 < argc)
+    {
+      cfg->sample_burst = atoi(argv[++i]);
+    }
+    else if (!strcmp(arg, "--audio-preroll") && i + 1 < argc)
+    {
+      cfg->audio_preroll = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--rendition") && i + 1 < argc)
+    {
+      if (cfg->rendition_count >= MAX_RENDITIONS)
+      {
+        fprintf(stderr, "At most %d --rendition inputs.\n", MAX_RENDITIONS);
+        return -1;
+      }
+      cfg->renditions[cfg->rendition_count++] = argv[++i];
+    }
+    else if (!strcmp(arg, "--align-tol") && i + 1 < argc)
+    {
+      cfg->align_tol = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--from") && i + 1 < argc)
+    {
+      cfg->clip_from = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--to") && i + 1 < argc)
+    {
+      cfg->clip_to = atof(argv[++i]);
+    }
+    else if (!strcmp(arg, "--edl") && i + 1 < argc)
+    {
+      cfg->edl = argv[++i];
+    }
+    else if (!strcmp(arg, "--append") && i + 1 < argc)
+    {
+      if (cfg->appended_count >= MAX_APPENDED)
+      {
+        fprintf(stderr, "At most %d --append files.\n", MAX_APPENDED);
+        return -1;
+      }
+      cfg->appended[cfg->appended_count++] = argv[++i];
+    }
     else if (!strcmp(arg, "--verbose"))
     {
       cfg->verbose = 1;
     }
-    else if (arg[0] == '-')
+    else if (arg[0] == '-' && arg[1] != '\0')
     {
       fprintf(stderr, "Unknown option: %s\n", arg);
       return -1;
@@ -188,12 +459,143 @@ static int parse_args(int argc, char **argv, cli_config *cfg)
   if (!cfg->final_out)
     cfg->skip_stitch = 1;
 
+  // Raw .264/.hevc/.ivf/.obu/.y4m inputs are indexed and split by byte ranges
+  cfg->es_input = es_detect(cfg->input);
+  cfg->y4m_input = y4m_detect(cfg->input);
+  if ((cfg->es_input != ES_FMT_NONE || cfg->y4m_input) &&
+      (cfg->fused || cfg->pack_output || cfg->cmaf_output || cfg->store_dir ||
+       cfg->plan_ndjson || cfg->native_ts || cfg->sample_stride > 0.0))
+  {
+    fprintf(stderr, "Raw ES and Y4M inputs are split by byte ranges "
+                    "(no --fused/--pack/--cmaf-chunks/--store/--plan-ndjson/--native-ts/--sample-probe).\n");
+    return -1;
+  }
+
+  if (cfg->rendition_count > 0 &&
+      (cfg->es_input != ES_FMT_NONE || cfg->y4m_input || cfg->fused || cfg->plan_ndjson ||
+       cfg->sample_stride > 0.0 || cfg->content_defined || cfg->store_dir || cfg->skip_split))
+  {
+    fprintf(stderr, "--rendition needs full probes of container inputs "
+                    "(no raw ES/Y4M, --fused/--plan-ndjson/--sample-probe/--content-defined/--store/--no-split).\n");
+    return -1;
+  }
+
+  if (cfg->appended_count > 0 &&
+      (cfg->es_input != ES_FMT_NONE || cfg->y4m_input || cfg->fused || cfg->plan_ndjson ||
+       cfg->sample_stride > 0.0 || cfg->store_dir || cfg->rendition_count > 0))
+  {
+    fprintf(stderr, "--append needs full probes of container inputs "
+                    "(no raw ES/Y4M, --fused/--plan-ndjson/--sample-probe/--store/--rendition).\n");
+    return -1;
+  }
+
+  if (cfg->edl &&
+      (cfg->es_input != ES_FMT_NONE || cfg->y4m_input || cfg->fused || cfg->plan_ndjson ||
+       cfg->pack_output || cfg->cmaf_output || cfg->store_dir || cfg->appended_count > 0 ||
+       cfg->rendition_count > 0 || cfg->clip_from > 0.0 || cfg->clip_to > 0.0 ||
+       cfg->content_defined || cfg->grid_dur > 0.0 || cfg->keyframes_only ||
+       cfg->sample_stride > 0.0 || cfg->target_bytes > 0 || cfg->nodes > 0))
+  {
+    fprintf(stderr, "--edl reads one container input into plain files and plans only on the "
+                    "listed ranges (no raw ES/Y4M, --fused/--plan-ndjson/--pack/--cmaf-chunks/"
+                    "--store/--append/--rendition/--from/--to/--content-defined/--grid/"
+                    "--keyframes-only/--sample-probe/--target-bytes/--nodes).\n");
+    return -1;
+  }
+
+  const int clip = cfg->clip_from > 0.0 || cfg->clip_to > 0.0;
+  if (clip && cfg->clip_to > 0.0 && cfg->clip_to <= cfg->clip_from)
+  {
+    fprintf(stderr, "--to must be after --from.\n");
+    return -1;
+  }
+  if (clip &&
+      (cfg->es_input != ES_FMT_NONE || cfg->y4m_input || cfg->fused || cfg->plan_ndjson ||
+       cfg->sample_stride > 0.0 || cfg->appended_count > 0 || cfg->rendition_count > 0))
+  {
+    fprintf(stderr, "--from/--to need a container input "
+                    "(no raw ES/Y4M, --fused/--plan-ndjson/--sample-probe/--append/--rendition).\n");
+    return -1;
+  }
+
+  // ES chunks come from an external encoder; there is nothing to split
+  if (cfg->es_chunk_ext)
+    cfg->skip_split = 1;
+
+  if (cfg->cmaf_output && cfg->pack_output)
+  {
+    fprintf(stderr, "--cmaf-chunks and --pack cannot be combined.\n");
+    return -1;
+  }
+
+  if (cfg->fused && (cfg->cmaf_output || cfg->pack_output || cfg->skip_split))
+  {
+    fprintf(stderr, "--fused needs plain chunk files (no --pack/--cmaf-chunks/--no-split).\n");
+    return -1;
+  }
+
+  if (cfg->store_dir && (cfg->pack_output || cfg->cmaf_output || cfg->fused))
+  {
+    fprintf(stderr, "--store needs plain chunk files (no --pack/--cmaf-chunks/--fused).\n");
+    return -1;
+  }
+
+  if (cfg->content_defined && (cfg->fused || cfg->plan_ndjson))
+  {
+    fprintf(stderr, "--content-defined needs the full probe (no --fused/--follow/--plan-ndjson).\n");
+    return -1;
+  }
+
+  if (cfg->target_bytes > 0 && (cfg->fused || cfg->plan_ndjson || cfg->content_defined || cfg->y4m_input))
+  {
+    fprintf(stderr, "--target-bytes needs the greedy two-pass planner (no --fused/--follow/"
+                    "--plan-ndjson/--content-defined, no Y4M input).\n");
+    return -1;
+  }
+
+  if (cfg->grid_dur > 0.0 && (cfg->fused || cfg->plan_ndjson || cfg->content_defined || cfg->y4m_input))
+  {
+    fprintf(stderr, "--grid needs the greedy two-pass planner (no --fused/--follow/--plan-ndjson/"
+                    "--content-defined, no Y4M input).\n");
+    return -1;
+  }
+
+  if (cfg->nodes > 0 && (cfg->fused || cfg->plan_ndjson || cfg->content_defined || cfg->y4m_input ||
+                         cfg->grid_dur > 0.0 || cfg->target_bytes > 0))
+  {
+    fprintf(stderr, "--nodes plans by balanced work over the full probe (no --fused/--follow/"
+                    "--plan-ndjson/--content-defined/--grid/--target-bytes, no Y4M input).\n");
+    return -1;
+  }
+
+  if (cfg->plan_ndjson && cfg->fused)
+  {
+    fprintf(stderr, "--plan-ndjson and --fused cannot be combined.\n");
+    return -1;
+  }
+
+  // CMAF chunks are stitched by concatenation: init.mp4 chunk_*.m4s
+  if (cfg->cmaf_output && !cfg->skip_stitch)
+  {
+    fprintf(stderr, "--cmaf-chunks: skipping stitch (concatenate init.mp4 + chunk_*.m4s)\n");
+    cfg->skip_stitch = 1;
+  }
+
+  // Both would interleave on stdout
+  if (cfg->plan_ndjson && !strcmp(cfg->plan_ndjson, "-") && cfg->final_out &&
+      !cfg->skip_stitch && stitch_is_pipe_output(cfg->final_out))
+  {
+    fprintf(stderr, "--plan-ndjson - and final output %s both write to stdout.\n",
+            cfg->final_out);
+    return -1;
+  }
+
   return 0;
 }
 
-static void dump_plan(const sc_chunk_plan *plan, int verbose)
+static void dump_plan(FILE *out, const sc_chunk_plan *plan, int verbose)
 {
-  fprintf(stdout, "Chunk plan (%d chunks):\n", plan->count);
+  fprintf(out, "Chunk plan (%d chunks):\n", plan->count);
 
   double total_complexity = 0.0;
   int total_keyframes = 0;
@@ -206,33 +608,75 @@ static void dump_plan(const sc_chunk_plan *plan, int verbose)
 
     if (verbose)
     {
-      fprintf(stdout, "  #%03d  %.3f -> %.3f  (%.3f s)  ",
-              c->index, c->start, c->end, duration);
-      fprintf(stdout, "complexity=%.2f  keyframes=%d  scenes=%d  quality=%.2f\n",
+      fprintf(out, "  #%03d  %.3f -> %.3f  (%.3f s, %.1f MiB)  ",
+              c->index, c->start, c->end, duration, c->bytes / (1024.0 * 1024.0));
+      fprintf(out, "complexity=%.2f  keyframes=%d  scenes=%d  quality=%.2f\n",
               c->avg_complexity, c->keyframe_count, c->scene_cut_count, c->quality_score);
 
       total_complexity += c->avg_complexity;
       total_keyframes += c->keyframe_count;
       total_scene_cuts += c->scene_cut_count;
     }
+    else if (c->bytes > 0)
+    {
+      fprintf(out, "  #%03d  %.3f -> %.3f  (%.3f s, %.1f MiB)\n",
+              c->index, c->start, c->end, duration, c->bytes / (1024.0 * 1024.0));
+    }
     else
     {
-      fprintf(stdout, "  #%03d  %.3f -> %.3f  (%.3f s)\n",
+      fprintf(out, "  #%03d  %.3f -> %.3f  (%.3f s)\n",
               c->index, c->start, c->end, duration);
     }
   }
 
   if (verbose && plan->count > 0)
   {
-    fprintf(stdout, "\nQuality Summary:\n");
-    fprintf(stdout, "  Avg complexity: %.2f\n", total_complexity / plan->count);
-    fprintf(stdout, "  Total keyframes: %d\n", total_keyframes);
-    fprintf(stdout, "  Total scene cuts: %d\n", total_scene_cuts);
-    fprintf(stdout, "  Avg keyframes/chunk: %.1f\n", (double)total_keyframes / plan->count);
+    fprintf(out, "\nQuality Summary:\n");
+    fprintf(out, "  Avg complexity: %.2f\n", total_complexity / plan->count);
+    fprintf(out, "  Total keyframes: %d\n", total_keyframes);
+    fprintf(out, "  Total scene cuts: %d\n", total_scene_cuts);
+    fprintf(out, "  Avg keyframes/chunk: %.1f\n", (double)total_keyframes / plan->count);
   }
 }
 
-static int write_plan_json(const char *path, const sc_chunk_plan *plan)
+// Macro level of a hierarchical plan, with the chunks each node runs
+static void dump_nodes(FILE *out, const sc_chunk_plan *nodes, const sc_chunk_plan *plan)
+{
+  fprintf(out, "Node plan (%d nodes):\n", nodes->count);
+
+  int first = 0;
+  for (int i = 0; i < nodes->count; i++)
+  {
+    const sc_chunk *n = &nodes->chunks[i];
+    int last = first;
+    while (last + 1 < plan->count && plan->chunks[last + 1].node == n->index)
+      last++;
+    fprintf(out, "  node %02d  %.3f -> %.3f  (%.3f s, chunks #%03d-#%03d)\n",
+            n->index, n->start, n->end, n->end - n->start,
+            plan->chunks[first].index, plan->chunks[last].index);
+    first = last + 1;
+  }
+}
+
+static void write_json_chunk(FILE *f, const sc_chunk *c, const split_store_entry *store,
+                             int node)
+{
+  fprintf(f, "{\"index\": %d, \"start\": %.3f, \"end\": %.3f",
+          c->index, c->start, c->end);
+  if (node)
+    fprintf(f, ", \"node\": %d", c->node);
+  if (c->bytes > 0)
+    fprintf(f, ", \"bytes\": %" PRId64, c->bytes);
+  if (store)
+    fprintf(f, ", \"key\": \"%s\", \"video_key\": \"%s\", \"stored\": %s",
+            store->key, store->video_key, store->hit ? "true" : "false");
+  fprintf(f, "}");
+}
+
+// A flat array of chunks, or with nodes an object holding both levels:
+// {"nodes": [...], "chunks": [... each with its "node" ...]}
+static int write_plan_json(const char *path, const sc_chunk_plan *plan,
+                           const split_store_entry *store, const sc_chunk_plan *nodes)
 {
   FILE *f = fopen(path, "w");
   if (!f)
@@ -241,21 +685,395 @@ static int write_plan_json(const char *path, const sc_chunk_plan *plan)
     return -1;
   }
 
+  const char *indent = nodes ? "    " : "  ";
+  if (nodes)
+  {
+    fprintf(f, "{\n  \"nodes\": [\n");
+    for (int i = 0; i < nodes->count; i++)
+    {
+      fprintf(f, "%s", indent);
+      write_json_chunk(f, &nodes->chunks[i], NULL, 0);
+      fprintf(f, "%s\n", (i + 1 == nodes->count) ? "" : ",");
+    }
+    fprintf(f, "  ],\n  \"chunks\": ");
+  }
+
   fprintf(f, "[\n");
   for (int i = 0; i < plan->count; i++)
   {
-    const sc_chunk *c = &plan->chunks[i];
-    fprintf(f,
-            "  {\"index\": %d, \"start\": %.3f, \"end\": %.3f}%s\n",
-            c->index, c->start, c->end,
-            (i + 1 == plan->count) ? "" : ",");
+    fprintf(f, "%s", indent);
+    write_json_chunk(f, &plan->chunks[i], store ? &store[i] : NULL, nodes != NULL);
+    fprintf(f, "%s\n", (i + 1 == plan->count) ? "" : ",");
   }
-  fprintf(f, "]\n");
+  fprintf(f, nodes ? "  ]\n}\n" : "]\n");
 
   fclose(f);
   return 0;
 }
 
+static sc_plan_config plan_config(const cli_config *cfg)
+{
+  sc_plan_config pcfg = {
+      .target_dur = cfg->target,
+      .min_dur = cfg->min_dur,
+      .max_dur = cfg->max_dur,
+      .avoid_tiny_last = cfg->avoid_tiny_last,
+      .min_chunks = cfg->min_chunks,
+      .max_chunks = cfg->max_chunks,
+      .ideal_parallel = cfg->ideal_parallel,
+      .enable_scene_detection = cfg->enable_scene_detection,
+      .enable_complexity_adapt = cfg->enable_complexity,
+      .enable_gop_analysis = 0,
+      .enable_balanced_dist = 0,
+      .scene_threshold = cfg->scene_threshold,
+      .complexity_weight = cfg->complexity_weight,
+      .enable_content_defined = cfg->content_defined,
+      .grid_dur = cfg->grid_dur,
+      .grid_tol = cfg->grid_tol,
+      .target_bytes = cfg->target_bytes,
+      .bytes_weight = cfg->bytes_weight,
+      .nodes = cfg->nodes,
+      .node_workers = cfg->node_workers};
+  return pcfg;
+}
+
+// One line per chunk, flushed so a scheduler reading the stream can
+// dispatch it right away
+static int emit_ndjson_chunk(const sc_chunk *c, void *opaque)
+{
+  FILE *f = opaque;
+  fprintf(f, "{\"index\": %d, \"start\": %.3f, \"end\": %.3f}\n",
+          c->index, c->start, c->end);
+  return fflush(f) == 0 ? 0 : -1;
+}
+
+static int plan_streaming(const cli_config *cfg, sc_chunk_plan *plan)
+{
+  int to_stdout = !strcmp(cfg->plan_ndjson, "-");
+  FILE *f = to_stdout ? stdout : fopen(cfg->plan_ndjson, "w");
+  if (!f)
+  {
+    fprintf(stderr, "Failed to open %s: %s\n", cfg->plan_ndjson, strerror(errno));
+    return 3;
+  }
+
+  int r = sc_plan_stream(cfg->input, plan_config(cfg), emit_ndjson_chunk, f, plan);
+  if (r == SC_OK)
+  {
+    fprintf(f, "{\"done\": true, \"count\": %d}\n", plan->count);
+    fflush(f);
+  }
+
+  if (!to_stdout)
+    fclose(f);
+
+  if (r != SC_OK)
+  {
+    fprintf(stderr, "sc_plan_stream failed for %s: %d\n", cfg->input, r);
+    return r == SC_ERR_FFMPEG || r == SC_ERR_NOSTREAM ? 2 : 3;
+  }
+  return 0;
+}
+
+// EDL time: seconds, or [[HH:]MM:]SS[.fff]
+static int parse_edl_time(const char *tok, double *out)
+{
+  double parts[3];
+  int n = 0;
+  const char *p = tok;
+  while (n < 3)
+  {
+    char *end = NULL;
+    parts[n++] = strtod(p, &end);
+    if (end == p)
+      return -1;
+    if (*end != ':')
+    {
+      if (*end != '\0')
+        return -1;
+      break;
+    }
+    p = end + 1;
+  }
+
+  double t = 0.0;
+  for (int i = 0; i < n; i++)
+    t = t * 60.0 + parts[i];
+  *out = t;
+  return 0;
+}
+
+// "start end" per line; blank lines and '#' comments are skipped
+static int read_edl(const char *path, sc_range **out, int *count)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+  {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  sc_range *ranges = NULL;
+  int n = 0;
+  int capacity = 0;
+  int line_no = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), f))
+  {
+    line_no++;
+    char *hash = strchr(line, '#');
+    if (hash)
+      *hash = '\0';
+
+    char a[128], b[128];
+    int fields = sscanf(line, "%127s %127s", a, b);
+    if (fields <= 0)
+      continue;
+
+    sc_range r;
+    if (fields != 2 || parse_edl_time(a, &r.start) < 0 || parse_edl_time(b, &r.end) < 0 ||
+        r.end <= r.start)
+    {
+      fprintf(stderr, "%s:%d: expected \"start end\"\n", path, line_no);
+      free(ranges);
+      fclose(f);
+      return -1;
+    }
+
+    if (n == capacity)
+    {
+      capacity = capacity ? capacity * 2 : 32;
+      sc_range *grown = realloc(ranges, capacity * sizeof(*grown));
+      if (!grown)
+      {
+        free(ranges);
+        fclose(f);
+        return -1;
+      }
+      ranges = grown;
+    }
+    ranges[n++] = r;
+  }
+  fclose(f);
+
+  *out = ranges;
+  *count = n;
+  return 0;
+}
+
+// --edl: plan the ranges on keyframes, then extract them all in one read
+static int run_edl(const cli_config *cfg, FILE *report)
+{
+  sc_range *ranges = NULL;
+  int count = 0;
+  if (read_edl(cfg->edl, &ranges, &count) < 0)
+    return 1;
+  if (count == 0)
+  {
+    fprintf(stderr, "%s lists no ranges.\n", cfg->edl);
+    free(ranges);
+    return 1;
+  }
+
+  // Only keyframe positions around the ranges matter here
+  sc_probe_result probe;
+  sc_chunk_plan plan;
+  memset(&plan, 0, sizeof(plan));
+  if (sc_probe_ranges(cfg->input, SC_PROBE_AUDIO, ranges, count, &probe) != SC_OK)
+  {
+    fprintf(stderr, "sc_probe_ranges failed for %s\n", cfg->input);
+    free(ranges);
+    return 2;
+  }
+
+  int exit_code = 0;
+  if (sc_plan_ranges(&probe, ranges, count, &plan) != SC_OK)
+  {
+    fprintf(stderr, "sc_plan_ranges failed (no range inside the source?).\n");
+    exit_code = 3;
+    goto done;
+  }
+
+  fprintf(report, "EDL: %d ranges, %d after widening to keyframes and merging\n",
+          count, plan.count);
+  dump_plan(report, &plan, cfg->verbose);
+  if (cfg->plan_json)
+    write_plan_json(cfg->plan_json, &plan, NULL, NULL);
+
+  if (!cfg->skip_split)
+  {
+    split_output_mode smode = {
+        .auto_mode = cfg->force_format ? 0 : 1,
+        .force_fmt = cfg->force_format};
+    int sr = split_ranges(cfg->input, &plan, cfg->final_out ? NULL : cfg->chunks_dir,
+                          cfg->final_out, &smode);
+    if (sr != SPLIT_OK)
+    {
+      fprintf(stderr, "split_ranges failed: %d\n", sr);
+      exit_code = 4;
+    }
+  }
+
+done:
+  sc_free_chunk_plan(&plan);
+  sc_free_probe(&probe);
+  free(ranges);
+  return exit_code;
+}
+
+// Input plus its --rendition siblings, all cut at the same points
+static int plan_renditions(const cli_config *cfg, FILE *report, sc_chunk_plan *plan)
+{
+  const char *inputs[MAX_RENDITIONS + 1];
+  int n = 0;
+  inputs[n++] = cfg->input;
+  for (int i = 0; i < cfg->rendition_count; i++)
+    inputs[n++] = cfg->renditions[i];
+
+  int probe_flags = 0;
+  if (cfg->keyframes_only)
+    probe_flags |= SC_PROBE_KEYFRAMES_ONLY;
+  if (cfg->native_ts)
+    probe_flags |= SC_PROBE_NATIVE_TS;
+
+  sc_align_report ar;
+  if (sc_plan_chunks_multi(inputs, n, probe_flags, plan_config(cfg), cfg->align_tol,
+                           plan, &ar) != SC_OK)
+  {
+    fprintf(stderr, "sc_plan_chunks_multi failed.\n");
+    return 3;
+  }
+
+  fprintf(report, "Renditions: %d inputs, %d shared keyframes (tolerance %.3f s)\n",
+          n, ar.common_keyframes, cfg->align_tol);
+  for (int i = 0; i < ar.count; i++)
+    fprintf(report, "  cut %.3f -> %.3f: no keyframe in %s\n",
+            ar.moves[i].wanted, ar.moves[i].actual, inputs[ar.moves[i].input]);
+  sc_free_align_report(&ar);
+  return 0;
+}
+
+// Probe the source and plan it; returns a process exit code
+static int plan_from_source(const cli_config *cfg, FILE *report, es_index *es,
+                            y4m_info *y4m, sc_timeline *tl, sc_probe_result *probe,
+                            sc_chunk_plan *plan)
+{
+  if (cfg->plan_ndjson)
+    return plan_streaming(cfg, plan);
+
+  // Fixed-size frames: layout and plan are arithmetic, nothing is probed
+  if (cfg->y4m_input)
+  {
+    int yr = y4m_open(cfg->input, y4m);
+    if (yr != Y4M_OK)
+    {
+      fprintf(stderr, "y4m_open failed for %s: %d\n", cfg->input, yr);
+      return 2;
+    }
+    fprintf(report, "Y4M input: %lld frames of %lld bytes at %d/%d fps\n",
+            (long long)y4m->frame_count, (long long)y4m->frame_size,
+            y4m->fps_num, y4m->fps_den);
+    if (y4m_plan(y4m, plan_config(cfg), plan) != SC_OK)
+    {
+      fprintf(stderr, "y4m_plan failed.\n");
+      return 3;
+    }
+    return 0;
+  }
+
+  if (cfg->es_input != ES_FMT_NONE)
+  {
+    int er = es_index_build(cfg->input, cfg->fps_num, cfg->fps_den, es);
+    if (er != ES_OK || es_index_to_probe(es, probe) != SC_OK)
+    {
+      fprintf(stderr, "es_index_build failed for %s: %d\n", cfg->input, er);
+      return 2;
+    }
+    int64_t keys = 0;
+    for (int64_t i = 0; i < es->count; i++)
+      keys += es->units[i].key;
+    fprintf(report, "Raw %s input: %lld access units, %lld keyframes\n",
+            es_format_ext(cfg->es_input), (long long)es->count, (long long)keys);
+  }
+  else if (cfg->sample_stride > 0.0)
+  {
+    if (sc_probe_sampled(cfg->input, cfg->sample_stride, cfg->sample_burst, probe) != SC_OK)
+    {
+      fprintf(stderr, "sc_probe_sampled failed for %s\n", cfg->input);
+      return 2;
+    }
+    if (probe->sample_error == 0.0)
+      fprintf(report, "Sampled probe: exact GOP sizes from the container index\n");
+    else if (probe->sample_error > 0.0)
+      fprintf(report, "Sampled probe: estimated GOP size error %.1f%%\n",
+              probe->sample_error * 100.0);
+    else
+      fprintf(report, "Sampled probe: too few samples to estimate the error\n");
+  }
+  else if (cfg->rendition_count > 0)
+  {
+    return plan_renditions(cfg, report, plan);
+  }
+  else
+  {
+    // Podcasts and audiobooks: fall back to the audio stream
+    int probe_flags = SC_PROBE_AUDIO;
+    if (cfg->keyframes_only)
+      probe_flags |= SC_PROBE_KEYFRAMES_ONLY;
+    if (cfg->native_ts)
+      probe_flags |= SC_PROBE_NATIVE_TS;
+    if (cfg->appended_count > 0)
+    {
+      // Card spans / rollovers: one timeline, chunks may cross files
+      const char *files[MAX_APPENDED + 1];
+      files[0] = cfg->input;
+      for (int i = 0; i < cfg->appended_count; i++)
+        files[i + 1] = cfg->appended[i];
+      if (sc_probe_timeline(files, cfg->appended_count + 1, probe_flags, probe, tl) != SC_OK)
+      {
+        fprintf(stderr, "sc_probe_timeline failed for %s\n", cfg->input);
+        return 2;
+      }
+      fprintf(report, "Timeline: %d files, %.3f s\n", tl->count, probe->duration);
+    }
+    else if (cfg->clip_from > 0.0 || cfg->clip_to > 0.0)
+    {
+      // Seek in, stop after the end: work scales with the clip
+      double to = cfg->clip_to > 0.0 ? cfg->clip_to : INFINITY;
+      if (sc_probe_range(cfg->input, probe_flags, cfg->clip_from, to, probe) != SC_OK)
+      {
+        fprintf(stderr, "sc_probe_range failed for %s\n", cfg->input);
+        return 2;
+      }
+      fprintf(report, "Clip: %.3f s from %.3f s\n", probe->duration, probe->time_offset);
+    }
+    else if (sc_probe_video_ex(cfg->input, probe_flags, probe) != SC_OK)
+    {
+      fprintf(stderr, "sc_probe_video failed for %s\n", cfg->input);
+      return 2;
+    }
+    if (probe->audio_only)
+      fprintf(report, "Audio-only input: %lld packets, every one a cut point (priming %.3f s)\n",
+              (long long)probe->count, probe->audio_priming);
+  }
+
+  sc_plan_config pcfg = plan_config(cfg);
+
+  if (cfg->enable_smart || cfg->enable_scene_detection || cfg->enable_complexity)
+  {
+    fprintf(report, "Smart Chunking enabled (scene_detect=%d, complexity=%d)\n",
+            cfg->enable_scene_detection, cfg->enable_complexity);
+  }
+
+  if (sc_plan_chunks(probe, pcfg, plan) != SC_OK)
+  {
+    fprintf(stderr, "sc_plan_chunks failed.\n");
+    return 3;
+  }
+
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
   cli_config cfg;
@@ -267,64 +1085,175 @@ int main(int argc, char **argv)
 
   av_log_set_level(AV_LOG_INFO);
 
+  // Keep stdout clean when it carries the stitched stream
+  FILE *report = stdout;
+  if (cfg.final_out && !cfg.skip_stitch && stitch_is_pipe_output(cfg.final_out))
+    report = stderr;
+  if (cfg.plan_ndjson && !strcmp(cfg.plan_ndjson, "-"))
+    report = stderr;
+
+  if (cfg.edl)
+    return run_edl(&cfg, report);
+
   sc_probe_result probe;
   sc_chunk_plan plan;
+  sc_chunk_plan nodes;
+  es_index es;
+  y4m_info y4m;
+  sc_timeline tl;
   memset(&probe, 0, sizeof(probe));
   memset(&plan, 0, sizeof(plan));
+  memset(&nodes, 0, sizeof(nodes));
+  memset(&es, 0, sizeof(es));
+  memset(&y4m, 0, sizeof(y4m));
+  memset(&tl, 0, sizeof(tl));
 
-  if (sc_probe_video(cfg.input, &probe) != SC_OK)
+  // Chunks written by the splitter carry their plan; a stitch-only run
+  // can rebuild it from the chunk directory without touching the source
+  split_output_mode smode = {
+      .auto_mode = cfg.force_format ? 0 : 1,
+      .force_fmt = cfg.force_format,
+      .output_frag = cfg.frag_output,
+      .pack_output = cfg.pack_output,
+      .cmaf_output = cfg.cmaf_output};
+  char pack_path[1024];
+  snprintf(pack_path, sizeof(pack_path), "%s/%s", cfg.chunks_dir, CHUNKPACK_NAME);
+
+  if (cfg.skip_split && !cfg.skip_stitch && !cfg.es_chunk_ext && !cfg.es_input && !cfg.y4m_input &&
+      stitch_scan_chunks(cfg.chunks_dir, NULL, cfg.pack_output ? pack_path : NULL, &plan) ==
+          STITCH_OK)
   {
-    fprintf(stderr, "sc_probe_video failed for %s\n", cfg.input);
-    return 2;
+    fprintf(report, "Plan recovered from chunk tags in %s\n", cfg.chunks_dir);
   }
-
-  sc_plan_config pcfg = {
-      .target_dur = cfg.target,
-      .min_dur = cfg.min_dur,
-      .max_dur = cfg.max_dur,
-      .avoid_tiny_last = cfg.avoid_tiny_last,
-      .min_chunks = cfg.min_chunks,
-      .max_chunks = cfg.max_chunks,
-      .ideal_parallel = cfg.ideal_parallel,
-      .enable_scene_detection = cfg.enable_scene_detection,
-      .enable_complexity_adapt = cfg.enable_complexity,
-      .enable_gop_analysis = 0,
-      .enable_balanced_dist = 0,
-      .scene_threshold = cfg.scene_threshold,
-      .complexity_weight = cfg.complexity_weight};
-
-  if (cfg.enable_smart || cfg.enable_scene_detection || cfg.enable_complexity)
+  else if (cfg.fused)
   {
-    fprintf(stdout, "Smart Chunking enabled (scene_detect=%d, complexity=%d)\n",
-            cfg.enable_scene_detection, cfg.enable_complexity);
+    // Chunks are cut while the source is read; the plan falls out of it
+    split_input_mode sin = {.follow = cfg.follow, .idle_timeout = cfg.follow_idle};
+    int sr = split_fused(cfg.input, &sin, plan_config(&cfg), cfg.chunks_dir, &smode, &plan);
+    if (sr != SPLIT_OK)
+    {
+      fprintf(stderr, "split_fused failed: %d\n", sr);
+      return 4;
+    }
+    cfg.skip_split = 1;
   }
+  else
+  {
+    int pr = plan_from_source(&cfg, report, &es, &y4m, &tl, &probe, &plan);
+    if (pr != 0)
+    {
+      sc_free_probe(&probe);
+      es_index_free(&es);
+      y4m_close(&y4m);
+      sc_free_timeline(&tl);
+      return pr;
+    }
+  }
+
+  dump_plan(report, &plan, cfg.verbose);
 
-  if (sc_plan_chunks(&probe, pcfg, &plan) != SC_OK)
+  int exit_code = 0;
+  split_store_entry *store = NULL;
+
+  // Cluster fan-out: node spans for the scheduler, chunks for the cores
+  if (cfg.nodes > 0)
   {
-    fprintf(stderr, "sc_plan_chunks failed.\n");
-    sc_free_probe(&probe);
-    return 3;
+    int nr = sc_plan_nodes(&plan, &nodes);
+    if (nr != SC_OK)
+    {
+      fprintf(stderr, "sc_plan_nodes failed: %d\n", nr);
+      exit_code = 3;
+      goto done;
+    }
+    dump_nodes(report, &nodes, &plan);
   }
 
-  dump_plan(&plan, cfg.verbose);
+  // Off-grid cuts cost the packager a re-segmentation; say so
+  int grid_misses = sc_plan_grid_misses(&plan, &probe, plan_config(&cfg));
+  if (grid_misses > 0)
+    fprintf(stderr, "Warning: %d of %d cuts are off the %.3f s grid "
+                    "(no keyframe on it within --max; GOP structure does not fit the grid)\n",
+            grid_misses, plan.count - 1, cfg.grid_dur);
 
-  if (cfg.plan_json)
-    write_plan_json(cfg.plan_json, &plan);
+  if (cfg.audio_preroll < 0.0)
+    cfg.audio_preroll = probe.audio_only ? DEFAULT_AUDIO_PREROLL : 0.0;
+  smode.audio_preroll = cfg.audio_preroll;
+  smode.timeline = tl.count > 0 ? &tl : NULL;
+  smode.clip_from = cfg.clip_from;
 
-  int exit_code = 0;
+  // With a store the JSON waits for the split so it can carry the keys
+  int store_split = cfg.store_dir && !cfg.skip_split;
+  if (cfg.plan_json && !store_split)
+    write_plan_json(cfg.plan_json, &plan, NULL, nodes.count > 0 ? &nodes : NULL);
 
   if (!cfg.skip_split)
   {
-    split_output_mode smode = {
-        .auto_mode = cfg.force_format ? 0 : 1,
-        .force_fmt = cfg.force_format,
-        .output_frag = cfg.frag_output};
-    int sr = split_all_chunks(cfg.input, &plan, cfg.chunks_dir, &smode);
-    if (sr != SPLIT_OK)
+    if (store_split)
     {
-      fprintf(stderr, "split_all_chunks failed: %d\n", sr);
-      exit_code = 4;
-      goto done;
+      store = calloc(plan.count, sizeof(*store));
+      if (!store)
+      {
+        exit_code = 4;
+        goto done;
+      }
+      smode.store_dir = cfg.store_dir;
+      smode.store_entries = store;
+    }
+
+    if (cfg.y4m_input)
+    {
+      int yr = y4m_split_all(&y4m, &plan, cfg.chunks_dir);
+      if (yr != Y4M_OK)
+      {
+        fprintf(stderr, "y4m_split_all failed: %d\n", yr);
+        exit_code = 4;
+        goto done;
+      }
+    }
+    else if (cfg.es_input)
+    {
+      int er = es_split_all(&es, &plan, cfg.chunks_dir);
+      if (er != ES_OK)
+      {
+        fprintf(stderr, "es_split_all failed: %d\n", er);
+        exit_code = 4;
+        goto done;
+      }
+    }
+    else
+    {
+      int sr = split_all_chunks(cfg.input, &plan, cfg.chunks_dir, &smode);
+      if (sr != SPLIT_OK)
+      {
+        fprintf(stderr, "split_all_chunks failed: %d\n", sr);
+        exit_code = 4;
+        goto done;
+      }
+
+      // Each rendition gets its own directory of identically cut chunks
+      for (int i = 0; i < cfg.rendition_count; i++)
+      {
+        char rdir[1024];
+        snprintf(rdir, sizeof(rdir), "%s/rendition_%d", cfg.chunks_dir, i + 1);
+        sr = split_all_chunks(cfg.renditions[i], &plan, rdir, &smode);
+        if (sr != SPLIT_OK)
+        {
+          fprintf(stderr, "split_all_chunks failed for %s: %d\n", cfg.renditions[i], sr);
+          exit_code = 4;
+          goto done;
+        }
+      }
+    }
+
+    if (store_split)
+    {
+      int hits = 0;
+      for (int i = 0; i < plan.count; i++)
+        hits += store[i].hit;
+      fprintf(report, "Chunk store: %d/%d chunks already stored (%.1f%% hit rate)\n",
+              hits, plan.count, plan.count ? 100.0 * hits / plan.count : 0.0);
+      if (cfg.plan_json)
+        write_plan_json(cfg.plan_json, &plan, store, nodes.count > 0 ? &nodes : NULL);
     }
   }
 
@@ -333,8 +1262,26 @@ int main(int argc, char **argv)
     stitch_output_mode stmode = {
         .auto_mode = cfg.force_format ? 0 : 1,
         .force_fmt = cfg.force_format,
-        .output_frag = cfg.frag_output};
-    int tr = stitch_chunks(cfg.final_out, &plan, cfg.chunks_dir, &stmode);
+        .output_frag = cfg.frag_output,
+        .package = cfg.package,
+        .segment_dur = cfg.segment_dur};
+    // Chunks split from a raw ES input are raw ES themselves
+    const char *es_ext = cfg.es_chunk_ext ? cfg.es_chunk_ext : es_format_ext(cfg.es_input);
+    stitch_input_mode stin = {
+        .chunk_ext = es_ext ? es_ext : (cfg.y4m_input ? "y4m" : NULL),
+        .es_input = es_ext ? 1 : 0,
+        .fps_num = cfg.fps_num,
+        .fps_den = cfg.fps_den,
+        .pack_path = cfg.pack_output ? pack_path : NULL,
+        .audio_preroll = cfg.audio_preroll};
+    // Annex-B/OBU chunks are stitched at the rate the source was indexed at
+    // (ES_DEFAULT_FPS without --fps); an IVF timebase is not a frame rate
+    if (es.tb_den > 0 && es.tb_num > 0 && es.format != ES_FMT_IVF)
+    {
+      stin.fps_num = es.tb_den;
+      stin.fps_den = es.tb_num;
+    }
+    int tr = stitch_chunks_ex(cfg.final_out, &plan, cfg.chunks_dir, &stin, &stmode);
     if (tr != STITCH_OK)
     {
       fprintf(stderr, "stitch_chunks failed: %d\n", tr);
@@ -344,7 +1291,12 @@ int main(int argc, char **argv)
   }
 
 done:
+  free(store);
+  sc_free_chunk_plan(&nodes);
   sc_free_chunk_plan(&plan);
   sc_free_probe(&probe);
+  es_index_free(&es);
+  y4m_close(&y4m);
+  sc_free_timeline(&tl);
   return exit_code;
 }
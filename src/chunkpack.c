@@ -0,0 +1,497 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L /* pread/pwrite */
+#endif
+
+#include "chunkpack.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/crc.h>
+
+#define PACK_MAGIC "CHKPACK1"
+#define PACK_VERSION 1
+#define PACK_ENTRY_SIZE 24
+#define PACK_TRAILER_SIZE 24
+#define PACK_IO_BUFSIZE (64 * 1024)
+
+// ---------------------------------------------------------
+// Little-endian helpers
+// ---------------------------------------------------------
+static void put_le32(uint8_t *p, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+  uint32_t v = 0;
+  for (int i = 3; i >= 0; i--)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+static int pread_full(int fd, uint8_t *buf, size_t len, uint64_t off)
+{
+  while (len > 0)
+  {
+    ssize_t n = pread(fd, buf, len, (off_t)off);
+    if (n <= 0)
+      return PACK_ERR_IO;
+    buf += n;
+    off += (uint64_t)n;
+    len -= (size_t)n;
+  }
+  return PACK_OK;
+}
+
+static int pwrite_full(int fd, const uint8_t *buf, size_t len, uint64_t off)
+{
+  while (len > 0)
+  {
+    ssize_t n = pwrite(fd, buf, len, (off_t)off);
+    if (n <= 0)
+      return PACK_ERR_IO;
+    buf += n;
+    off += (uint64_t)n;
+    len -= (size_t)n;
+  }
+  return PACK_OK;
+}
+
+static int range_crc(int fd, uint64_t off, uint64_t len, uint32_t *crc_out)
+{
+  const AVCRC *table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+  uint8_t *buf = malloc(PACK_IO_BUFSIZE);
+  if (!buf)
+    return PACK_ERR_NOMEM;
+
+  uint32_t crc = UINT32_MAX;
+  while (len > 0)
+  {
+    size_t n = len > PACK_IO_BUFSIZE ? PACK_IO_BUFSIZE : (size_t)len;
+    if (pread_full(fd, buf, n, off) != PACK_OK)
+    {
+      free(buf);
+      return PACK_ERR_IO;
+    }
+    crc = av_crc(table, crc, buf, n);
+    off += n;
+    len -= n;
+  }
+
+  free(buf);
+  *crc_out = crc ^ UINT32_MAX;
+  return PACK_OK;
+}
+
+// ---------------------------------------------------------
+// AVIO over a byte range of the pack
+// ---------------------------------------------------------
+typedef struct
+{
+  int fd;
+  uint64_t base;
+  uint64_t pos;
+  uint64_t len;
+} pack_range;
+
+static int range_read(void *opaque, uint8_t *buf, int size)
+{
+  pack_range *r = opaque;
+  if (r->pos >= r->len)
+    return AVERROR_EOF;
+
+  uint64_t left = r->len - r->pos;
+  size_t n = (uint64_t)size < left ? (size_t)size : (size_t)left;
+  ssize_t got = pread(r->fd, buf, n, (off_t)(r->base + r->pos));
+  if (got <= 0)
+    return got == 0 ? AVERROR_EOF : AVERROR(EIO);
+
+  r->pos += (uint64_t)got;
+  return (int)got;
+}
+
+static int range_write(void *opaque, const uint8_t *buf, int size)
+{
+  pack_range *r = opaque;
+  if (pwrite_full(r->fd, buf, (size_t)size, r->base + r->pos) != PACK_OK)
+    return AVERROR(EIO);
+
+  r->pos += (uint64_t)size;
+  if (r->pos > r->len)
+    r->len = r->pos;
+  return size;
+}
+
+static int64_t range_seek(void *opaque, int64_t offset, int whence)
+{
+  pack_range *r = opaque;
+  int64_t target;
+
+  switch (whence & ~AVSEEK_FORCE)
+  {
+  case AVSEEK_SIZE:
+    return (int64_t)r->len;
+  case SEEK_SET:
+    target = offset;
+    break;
+  case SEEK_CUR:
+    target = (int64_t)r->pos + offset;
+    break;
+  case SEEK_END:
+    target = (int64_t)r->len + offset;
+    break;
+  default:
+    return AVERROR(EINVAL);
+  }
+
+  if (target < 0)
+    return AVERROR(EINVAL);
+  r->pos = (uint64_t)target;
+  return target;
+}
+
+static AVIOContext *range_avio(pack_range *r, int write_flag)
+{
+  unsigned char *buf = av_malloc(PACK_IO_BUFSIZE);
+  if (!buf)
+    return NULL;
+
+  AVIOContext *pb = avio_alloc_context(buf, PACK_IO_BUFSIZE, write_flag, r,
+                                       write_flag ? NULL : range_read,
+                                       write_flag ? range_write : NULL,
+                                       range_seek);
+  if (!pb)
+    av_free(buf);
+  return pb;
+}
+
+static void range_avio_free(AVIOContext **pb)
+{
+  if (!pb || !*pb)
+    return;
+  free((*pb)->opaque);
+  av_freep(&(*pb)->buffer);
+  avio_context_free(pb);
+}
+
+static int ensure_entry_capacity(chunkpack *pack, int needed)
+{
+  if (needed <= pack->capacity)
+    return PACK_OK;
+
+  int newcap = pack->capacity ? pack->capacity * 2 : 64;
+  if (newcap < needed)
+    newcap = needed;
+
+  chunkpack_entry *entries = realloc(pack->entries, newcap * sizeof(*entries));
+  if (!entries)
+    return PACK_ERR_NOMEM;
+
+  pack->entries = entries;
+  pack->capacity = newcap;
+  return PACK_OK;
+}
+
+// ---------------------------------------------------------
+// Writer
+// ---------------------------------------------------------
+int chunkpack_create(const char *path, chunkpack *pack)
+{
+  if (!path || !pack)
+    return PACK_ERR_OPEN;
+
+  memset(pack, 0, sizeof(*pack));
+  pack->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (pack->fd < 0)
+    return PACK_ERR_OPEN;
+
+  pack->writable = 1;
+  return PACK_OK;
+}
+
+int chunkpack_begin_chunk(chunkpack *pack, AVIOContext **pb)
+{
+  if (!pack || !pack->writable || !pb)
+    return PACK_ERR_IO;
+
+  pack_range *r = calloc(1, sizeof(*r));
+  if (!r)
+    return PACK_ERR_NOMEM;
+
+  r->fd = pack->fd;
+  r->base = pack->end;
+
+  *pb = range_avio(r, 1);
+  if (!*pb)
+  {
+    free(r);
+    return PACK_ERR_NOMEM;
+  }
+  return PACK_OK;
+}
+
+int chunkpack_end_chunk(chunkpack *pack, int index, AVIOContext **pb)
+{
+  if (!pack || !pb || !*pb)
+    return PACK_ERR_IO;
+
+  avio_flush(*pb);
+  int rc = (*pb)->error < 0 ? PACK_ERR_IO : PACK_OK;
+
+  pack_range *r = (*pb)->opaque;
+  uint64_t base = r->base;
+  uint64_t len = r->len;
+  range_avio_free(pb);
+
+  if (rc != PACK_OK)
+    return rc;
+  if (ensure_entry_capacity(pack, pack->count + 1) != PACK_OK)
+    return PACK_ERR_NOMEM;
+
+  chunkpack_entry *e = &pack->entries[pack->count];
+  e->index = index;
+  e->offset = base;
+  e->length = len;
+
+  // The muxer may have patched earlier bytes, so checksum what landed
+  rc = range_crc(pack->fd, base, len, &e->crc32);
+  if (rc != PACK_OK)
+    return rc;
+
+  pack->count++;
+  pack->end = base + len;
+  return PACK_OK;
+}
+
+int chunkpack_abort_chunk(chunkpack *pack, AVIOContext **pb)
+{
+  range_avio_free(pb);
+  // A failed last chunk would otherwise sit between the data and the
+  // index footer
+  if (ftruncate(pack->fd, (off_t)pack->end) != 0)
+    return PACK_ERR_IO;
+  return PACK_OK;
+}
+
+static int write_index(chunkpack *pack)
+{
+  size_t size = (size_t)pack->count * PACK_ENTRY_SIZE + PACK_TRAILER_SIZE;
+  uint8_t *buf = malloc(size);
+  if (!buf)
+    return PACK_ERR_NOMEM;
+
+  uint8_t *p = buf;
+  for (int i = 0; i < pack->count; i++, p += PACK_ENTRY_SIZE)
+  {
+    put_le32(p, (uint32_t)pack->entries[i].index);
+    put_le32(p + 4, pack->entries[i].crc32);
+    put_le64(p + 8, pack->entries[i].offset);
+    put_le64(p + 16, pack->entries[i].length);
+  }
+
+  put_le64(p, pack->end);
+  put_le32(p + 8, (uint32_t)pack->count);
+  put_le32(p + 12, PACK_VERSION);
+  memcpy(p + 16, PACK_MAGIC, 8);
+
+  int rc = pwrite_full(pack->fd, buf, size, pack->end);
+  free(buf);
+  return rc;
+}
+
+// ---------------------------------------------------------
+// Reader
+// ---------------------------------------------------------
+int chunkpack_open(const char *path, chunkpack *pack)
+{
+  if (!path || !pack)
+    return PACK_ERR_OPEN;
+
+  memset(pack, 0, sizeof(*pack));
+  pack->fd = open(path, O_RDONLY);
+  if (pack->fd < 0)
+    return PACK_ERR_OPEN;
+
+  int rc = PACK_ERR_FORMAT;
+  uint8_t trailer[PACK_TRAILER_SIZE];
+  uint8_t *index = NULL;
+  struct stat sb;
+
+  if (fstat(pack->fd, &sb) != 0 || (uint64_t)sb.st_size < PACK_TRAILER_SIZE)
+    goto fail;
+  uint64_t file_size = (uint64_t)sb.st_size;
+
+  if (pread_full(pack->fd, trailer, sizeof(trailer), file_size - PACK_TRAILER_SIZE) != PACK_OK)
+  {
+    rc = PACK_ERR_IO;
+    goto fail;
+  }
+  if (memcmp(trailer + 16, PACK_MAGIC, 8) || get_le32(trailer + 12) != PACK_VERSION)
+    goto fail;
+
+  uint64_t index_off = get_le64(trailer);
+  uint32_t count = get_le32(trailer + 8);
+  if (index_off + (uint64_t)count * PACK_ENTRY_SIZE + PACK_TRAILER_SIZE != file_size)
+    goto fail;
+
+  if (ensure_entry_capacity(pack, (int)count) != PACK_OK)
+  {
+    rc = PACK_ERR_NOMEM;
+    goto fail;
+  }
+
+  index = malloc((size_t)count * PACK_ENTRY_SIZE + 1);
+  if (!index)
+  {
+    rc = PACK_ERR_NOMEM;
+    goto fail;
+  }
+  if (pread_full(pack->fd, index, (size_t)count * PACK_ENTRY_SIZE, index_off) != PACK_OK)
+  {
+    rc = PACK_ERR_IO;
+    goto fail;
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const uint8_t *p = index + (size_t)i * PACK_ENTRY_SIZE;
+    chunkpack_entry *e = &pack->entries[i];
+    e->index = (int)get_le32(p);
+    e->crc32 = get_le32(p + 4);
+    e->offset = get_le64(p + 8);
+    e->length = get_le64(p + 16);
+    if (e->offset + e->length > index_off)
+      goto fail;
+  }
+
+  free(index);
+  pack->count = (int)count;
+  pack->end = index_off;
+  return PACK_OK;
+
+fail:
+  free(index);
+  chunkpack_close(pack);
+  return rc;
+}
+
+const chunkpack_entry *chunkpack_find(const chunkpack *pack, int index)
+{
+  if (!pack)
+    return NULL;
+
+  // Entries are appended in split order, which is normally index order
+  if (index >= 0 && index < pack->count && pack->entries[index].index == index)
+    return &pack->entries[index];
+
+  for (int i = 0; i < pack->count; i++)
+    if (pack->entries[i].index == index)
+      return &pack->entries[i];
+  return NULL;
+}
+
+int chunkpack_open_chunk(const chunkpack *pack, int index,
+                         const AVInputFormat *fmt,
+                         AVFormatContext **ctx)
+{
+  const chunkpack_entry *e = chunkpack_find(pack, index);
+  if (!e || !ctx)
+    return PACK_ERR_NOTFOUND;
+
+  pack_range *r = calloc(1, sizeof(*r));
+  if (!r)
+    return PACK_ERR_NOMEM;
+
+  r->fd = pack->fd;
+  r->base = e->offset;
+  r->len = e->length;
+
+  AVIOContext *pb = range_avio(r, 0);
+  if (!pb)
+  {
+    free(r);
+    return PACK_ERR_NOMEM;
+  }
+
+  *ctx = avformat_alloc_context();
+  if (!*ctx)
+  {
+    range_avio_free(&pb);
+    return PACK_ERR_NOMEM;
+  }
+
+  (*ctx)->pb = pb;
+  (*ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+  // avformat_open_input frees the context on failure, never a custom pb
+  if (avformat_open_input(ctx, NULL, fmt, NULL) < 0)
+  {
+    range_avio_free(&pb);
+    return PACK_ERR_FFMPEG;
+  }
+  return PACK_OK;
+}
+
+void chunkpack_close_chunk(AVFormatContext **ctx)
+{
+  if (!ctx || !*ctx)
+    return;
+
+  AVIOContext *pb = (*ctx)->pb;
+  avformat_close_input(ctx);
+  range_avio_free(&pb);
+}
+
+int chunkpack_verify_chunk(const chunkpack *pack, int index)
+{
+  const chunkpack_entry *e = chunkpack_find(pack, index);
+  if (!e)
+    return PACK_ERR_NOTFOUND;
+
+  uint32_t crc = 0;
+  int rc = range_crc(pack->fd, e->offset, e->length, &crc);
+  if (rc != PACK_OK)
+    return rc;
+  return crc == e->crc32 ? PACK_OK : PACK_ERR_CHECKSUM;
+}
+
+int chunkpack_close(chunkpack *pack)
+{
+  if (!pack)
+    return PACK_OK;
+
+  int rc = PACK_OK;
+  if (pack->writable && pack->fd >= 0)
+    rc = write_index(pack);
+
+  if (pack->fd >= 0 && close(pack->fd) != 0 && rc == PACK_OK)
+    rc = PACK_ERR_IO;
+
+  free(pack->entries);
+  memset(pack, 0, sizeof(*pack));
+  pack->fd = -1;
+  return rc;
+}
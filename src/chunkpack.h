@@ -0,0 +1,92 @@
+#ifndef CHUNKPACK_H
+#define CHUNKPACK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Chunk pack: every chunk of a plan appended to one file, followed by an
+ * index footer. Keeps thousands of small chunk files off the filesystem
+ * metadata path / object-store PUT budget.
+ *
+ *   [chunk 0][chunk 1]...[chunk N-1][index: N x entry][trailer]
+ *
+ *   entry   : u32 index, u32 crc32, u64 offset, u64 length   (24 bytes, LE)
+ *   trailer : u64 index_offset, u32 count, u32 version, "CHKPACK1"
+ */
+
+enum
+{
+    PACK_OK = 0,
+    PACK_ERR_OPEN = -50,
+    PACK_ERR_IO = -51,
+    PACK_ERR_FORMAT = -52,
+    PACK_ERR_NOMEM = -53,
+    PACK_ERR_NOTFOUND = -54,
+    PACK_ERR_CHECKSUM = -55,
+    PACK_ERR_FFMPEG = -56
+};
+
+#define CHUNKPACK_NAME "chunks.pack"
+
+typedef struct
+{
+    int index;
+    uint32_t crc32;
+    uint64_t offset;
+    uint64_t length;
+} chunkpack_entry;
+
+typedef struct
+{
+    int fd;
+    int writable;
+    chunkpack_entry *entries;
+    int count;
+    int capacity;
+    uint64_t end; /* append position (writer) */
+} chunkpack;
+
+struct AVFormatContext;
+struct AVInputFormat;
+struct AVIOContext;
+
+/* Writer: create, append chunks through an AVIO, then close (writes index) */
+int chunkpack_create(const char *path, chunkpack *pack);
+
+/* Seekable AVIO over the next free range; the muxer may seek within it */
+int chunkpack_begin_chunk(chunkpack *pack, struct AVIOContext **pb);
+
+/* Seal the range written through pb as chunk `index` and free pb */
+int chunkpack_end_chunk(chunkpack *pack, int index, struct AVIOContext **pb);
+
+/* Drop a failed chunk: the file is cut back to where it began, and the
+ * range is reused by the next chunk */
+int chunkpack_abort_chunk(chunkpack *pack, struct AVIOContext **pb);
+
+/* Reader: load the index footer */
+int chunkpack_open(const char *path, chunkpack *pack);
+
+const chunkpack_entry *chunkpack_find(const chunkpack *pack, int index);
+
+/* Demux one chunk straight from its byte range (fmt may be NULL).
+   Safe to call from several threads on one pack. */
+int chunkpack_open_chunk(const chunkpack *pack, int index,
+                         const struct AVInputFormat *fmt,
+                         struct AVFormatContext **ctx);
+void chunkpack_close_chunk(struct AVFormatContext **ctx);
+
+/* Re-read a chunk's bytes and compare against its stored CRC-32 */
+int chunkpack_verify_chunk(const chunkpack *pack, int index);
+
+/* Writer: append index + trailer. Both: release the pack. */
+int chunkpack_close(chunkpack *pack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHUNKPACK_H */
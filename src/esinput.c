@@ -0,0 +1,658 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L /* pread, mmap */
+#endif
+
+#include "esinput.h"
+#include "rangeio.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IVF_HEADER_SIZE 32
+#define IVF_FRAME_HEADER 12
+
+// Parameter-set slots in es_params
+#define ES_SLOT_VPS 0
+#define ES_SLOT_SPS 1
+#define ES_SLOT_PPS 2
+
+// AV1 OBU types
+#define OBU_SEQUENCE_HEADER 1
+#define OBU_TEMPORAL_DELIMITER 2
+#define OBU_FRAME_HEADER 3
+#define OBU_FRAME 6
+
+static const double EPS = 1e-6;
+
+// ---------------------------------------------------------
+// Little-endian helpers (IVF)
+// ---------------------------------------------------------
+static uint32_t get_le32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+  return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// ---------------------------------------------------------
+// Format detection
+// ---------------------------------------------------------
+es_format es_detect(const char *path)
+{
+  const char *ext = path ? strrchr(path, '.') : NULL;
+  if (!ext || strchr(ext, '/'))
+    return ES_FMT_NONE;
+  ext++;
+
+  if (!strcasecmp(ext, "264") || !strcasecmp(ext, "h264") || !strcasecmp(ext, "avc"))
+    return ES_FMT_H264;
+  if (!strcasecmp(ext, "265") || !strcasecmp(ext, "h265") || !strcasecmp(ext, "hevc"))
+    return ES_FMT_HEVC;
+  if (!strcasecmp(ext, "obu"))
+    return ES_FMT_OBU;
+  if (strcasecmp(ext, "ivf"))
+    return ES_FMT_NONE;
+
+  uint8_t sig[4];
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return ES_FMT_NONE;
+  size_t n = fread(sig, 1, sizeof(sig), f);
+  fclose(f);
+  return (n == sizeof(sig) && !memcmp(sig, "DKIF", 4)) ? ES_FMT_IVF : ES_FMT_NONE;
+}
+
+const char *es_format_ext(es_format fmt)
+{
+  switch (fmt)
+  {
+  case ES_FMT_H264:
+    return "264";
+  case ES_FMT_HEVC:
+    return "hevc";
+  case ES_FMT_IVF:
+    return "ivf";
+  case ES_FMT_OBU:
+    return "obu";
+  default:
+    return NULL;
+  }
+}
+
+// ---------------------------------------------------------
+// Index building state
+// ---------------------------------------------------------
+typedef struct
+{
+  es_index *idx;
+  es_params cur;    // parameter sets seen so far
+  int params_dirty; // cur changed since the last snapshot
+  int unit_has_vcl; // the open unit already holds picture data
+} es_builder;
+
+static int push_unit(es_builder *b, int64_t offset, int64_t pts)
+{
+  es_index *idx = b->idx;
+  if (idx->count > 0)
+  {
+    es_unit *prev = &idx->units[idx->count - 1];
+    prev->size = offset - prev->offset;
+  }
+
+  if (idx->count + 1 > idx->capacity)
+  {
+    int64_t newcap = idx->capacity ? idx->capacity * 2 : 4096;
+    es_unit *units = realloc(idx->units, (size_t)newcap * sizeof(*units));
+    if (!units)
+      return ES_ERR_NOMEM;
+    idx->units = units;
+    idx->capacity = newcap;
+  }
+
+  es_unit *u = &idx->units[idx->count++];
+  memset(u, 0, sizeof(*u));
+  u->offset = offset;
+  u->pts = pts;
+  u->params = -1;
+  b->unit_has_vcl = 0;
+  return ES_OK;
+}
+
+// First picture data of a unit: pin the parameter sets it decodes with
+static int unit_vcl(es_builder *b, int key)
+{
+  es_index *idx = b->idx;
+  es_unit *u = &idx->units[idx->count - 1];
+
+  if (!b->unit_has_vcl)
+  {
+    if (b->params_dirty)
+    {
+      if (idx->param_count + 1 > idx->param_capacity)
+      {
+        int newcap = idx->param_capacity ? idx->param_capacity * 2 : 16;
+        es_params *p = realloc(idx->params, (size_t)newcap * sizeof(*p));
+        if (!p)
+          return ES_ERR_NOMEM;
+        idx->params = p;
+        idx->param_capacity = newcap;
+      }
+      idx->params[idx->param_count++] = b->cur;
+      b->params_dirty = 0;
+    }
+    u->params = idx->param_count - 1;
+  }
+  b->unit_has_vcl = 1;
+  if (key)
+    u->key = 1;
+  return ES_OK;
+}
+
+static void unit_param(es_builder *b, int slot, int64_t offset, int64_t size)
+{
+  b->cur.nal[slot].offset = offset;
+  b->cur.nal[slot].size = size;
+  b->params_dirty = 1;
+  if (!b->unit_has_vcl)
+    b->idx->units[b->idx->count - 1].has_params = 1;
+}
+
+// ---------------------------------------------------------
+// Annex-B (H.264 / HEVC)
+// ---------------------------------------------------------
+
+// Next 00 00 01 at or after pos; returns its offset or len
+static int64_t next_start_code(const uint8_t *buf, int64_t len, int64_t pos)
+{
+  while (pos + 3 <= len)
+  {
+    const uint8_t *p = memchr(buf + pos + 2, 0x01, (size_t)(len - pos - 2));
+    if (!p)
+      return len;
+    int64_t one = p - buf;
+    if (buf[one - 1] == 0 && buf[one - 2] == 0)
+      return one - 2;
+    pos = one - 1;
+  }
+  return len;
+}
+
+typedef struct
+{
+  int vcl;
+  int key;
+  int first_slice; // starts a new picture
+  int starts_unit; // non-VCL NAL that opens an access unit after a picture
+  int delimiter;   // AUD
+  int slot;        // parameter-set slot or -1
+} nal_info;
+
+static nal_info classify_nal(es_format fmt, const uint8_t *nal, int64_t len)
+{
+  nal_info ni = {0, 0, 0, 0, 0, -1};
+  if (fmt == ES_FMT_H264)
+  {
+    int t = nal[0] & 0x1F;
+    ni.vcl = (t == 1 || t == 5);
+    ni.key = (t == 5);
+    ni.first_slice = ni.vcl && len > 1 && (nal[1] & 0x80); // first_mb_in_slice == 0
+    ni.delimiter = (t == 9);
+    ni.starts_unit = (t == 6 || t == 7 || t == 8 || t == 9 || (t >= 14 && t <= 18));
+    if (t == 7)
+      ni.slot = ES_SLOT_SPS;
+    else if (t == 8)
+      ni.slot = ES_SLOT_PPS;
+  }
+  else
+  {
+    int t = (nal[0] >> 1) & 0x3F;
+    ni.vcl = (t < 32);
+    // IDR and BLA: no leading picture needs anything before the cut
+    ni.key = (t >= 16 && t <= 20);
+    ni.first_slice = ni.vcl && len > 2 && (nal[2] & 0x80); // first_slice_segment_in_pic_flag
+    ni.delimiter = (t == 35);
+    ni.starts_unit = ((t >= 32 && t <= 35) || t == 39 || (t >= 41 && t <= 44) ||
+                      (t >= 48 && t <= 55));
+    if (t >= 32 && t <= 34)
+      ni.slot = t - 32;
+  }
+  return ni;
+}
+
+static int index_annexb(es_builder *b, const uint8_t *buf, int64_t len)
+{
+  es_index *idx = b->idx;
+  int64_t pos = next_start_code(buf, len, 0);
+  int64_t frame = 0;
+
+  while (pos < len)
+  {
+    int64_t payload = pos + 3;
+    int64_t next = next_start_code(buf, len, payload);
+    // A four-byte start code's leading zero belongs to the next NAL
+    int64_t end = (next < len && next > payload && buf[next - 1] == 0) ? next - 1 : next;
+    int64_t start = (pos > 0 && buf[pos - 1] == 0) ? pos - 1 : pos;
+    if (payload >= end)
+    {
+      pos = next;
+      continue;
+    }
+
+    nal_info ni = classify_nal(idx->format, buf + payload, end - payload);
+    int r;
+
+    if (idx->count == 0 || (b->unit_has_vcl && (ni.starts_unit || ni.first_slice)))
+    {
+      if ((r = push_unit(b, start, frame++)) != ES_OK)
+        return r;
+    }
+
+    es_unit *u = &idx->units[idx->count - 1];
+    if (ni.delimiter && start == u->offset)
+      u->prefix_len = (int)(end - start);
+    if (ni.slot >= 0)
+      unit_param(b, ni.slot, start, end - start);
+    if (ni.vcl && (r = unit_vcl(b, ni.key)) != ES_OK)
+      return r;
+
+    pos = next;
+  }
+
+  if (idx->count > 0)
+    idx->units[idx->count - 1].size = len - idx->units[idx->count - 1].offset;
+  return ES_OK;
+}
+
+// ---------------------------------------------------------
+// AV1 OBUs (low-overhead format; also the payload of AV1 IVF frames)
+// ---------------------------------------------------------
+static int read_leb128(const uint8_t *p, int64_t len, uint64_t *value)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < 8 && i < len; i++)
+  {
+    v |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+    if (!(p[i] & 0x80))
+    {
+      *value = v;
+      return i + 1;
+    }
+  }
+  return -1;
+}
+
+// Walk the OBUs in buf[0, len) (file offset base). new_units: a temporal
+// delimiter opens a unit (.obu files); otherwise buf is one unit (IVF).
+static int index_obus(es_builder *b, const uint8_t *buf, int64_t len,
+                      int64_t base, int new_units, int64_t *frame)
+{
+  es_index *idx = b->idx;
+  int64_t pos = 0;
+
+  while (pos < len)
+  {
+    uint8_t h = buf[pos];
+    int type = (h >> 3) & 0x0F;
+    int hdr = 1 + ((h >> 2) & 1);
+    if (!(h & 0x02) || pos + hdr >= len) // obu_has_size_field
+      return ES_ERR_FORMAT;
+
+    uint64_t size;
+    int leb = read_leb128(buf + pos + hdr, len - pos - hdr, &size);
+    if (leb < 0 || size > (uint64_t)(len - pos - hdr - leb))
+      return ES_ERR_FORMAT;
+    int64_t obu_len = hdr + leb + (int64_t)size;
+    const uint8_t *payload = buf + pos + hdr + leb;
+    int r;
+
+    if (type == OBU_TEMPORAL_DELIMITER)
+    {
+      if (new_units && (r = push_unit(b, base + pos, (*frame)++)) != ES_OK)
+        return r;
+      es_unit *u = &idx->units[idx->count - 1];
+      if (base + pos == u->offset + (new_units ? 0 : IVF_FRAME_HEADER))
+        u->prefix_len = (int)obu_len;
+    }
+    else if (idx->count == 0)
+    {
+      return ES_ERR_FORMAT; // .obu must open with a temporal delimiter
+    }
+    else if (type == OBU_SEQUENCE_HEADER)
+    {
+      unit_param(b, ES_SLOT_SPS, base + pos, obu_len);
+    }
+    else if (type == OBU_FRAME_HEADER || type == OBU_FRAME)
+    {
+      // show_existing_frame = 0 and frame_type = KEY_FRAME (full headers)
+      int key = size > 0 && !b->unit_has_vcl && (payload[0] & 0xE0) == 0;
+      if ((r = unit_vcl(b, key)) != ES_OK)
+        return r;
+    }
+
+    pos += obu_len;
+  }
+  return ES_OK;
+}
+
+// ---------------------------------------------------------
+// IVF (VP8 / VP9 / AV1)
+// ---------------------------------------------------------
+static int vpx_is_key(uint32_t fourcc, const uint8_t *data, int64_t len)
+{
+  if (len < 1)
+    return 0;
+  if (fourcc == get_le32((const uint8_t *)"VP80"))
+    return !(data[0] & 0x01);
+
+  // VP9 uncompressed header: frame_marker(2) profile(2) [reserved(1)]
+  // show_existing_frame(1) frame_type(1)
+  int profile = ((data[0] >> 5) & 1) | (((data[0] >> 4) & 1) << 1);
+  int bit = profile == 3 ? 5 : 4;
+  if ((data[0] >> 6) != 2 || ((data[0] >> (7 - bit)) & 1))
+    return 0;
+  return !((data[0] >> (6 - bit)) & 1);
+}
+
+static int index_ivf(es_builder *b, const uint8_t *buf, int64_t len)
+{
+  es_index *idx = b->idx;
+  if (len < IVF_HEADER_SIZE || memcmp(buf, "DKIF", 4))
+    return ES_ERR_FORMAT;
+
+  int hdr_len = buf[6] | (buf[7] << 8);
+  uint32_t fourcc = get_le32(buf + 8);
+  int is_av1 = fourcc == get_le32((const uint8_t *)"AV01");
+  if (!is_av1 && fourcc != get_le32((const uint8_t *)"VP80") &&
+      fourcc != get_le32((const uint8_t *)"VP90"))
+    return ES_ERR_FORMAT;
+
+  memcpy(idx->ivf_header, buf, IVF_HEADER_SIZE);
+  idx->tb_den = (int)get_le32(buf + 16);
+  idx->tb_num = (int)get_le32(buf + 20);
+  if (idx->tb_num <= 0 || idx->tb_den <= 0)
+    return ES_ERR_FORMAT;
+
+  int64_t pos = hdr_len < IVF_HEADER_SIZE ? IVF_HEADER_SIZE : hdr_len;
+  int64_t frame = 0;
+  while (pos + IVF_FRAME_HEADER <= len)
+  {
+    int64_t size = get_le32(buf + pos);
+    int64_t pts = (int64_t)get_le64(buf + pos + 4);
+    const uint8_t *data = buf + pos + IVF_FRAME_HEADER;
+    if (pos + IVF_FRAME_HEADER + size > len)
+      break; // truncated last frame
+
+    int r = push_unit(b, pos, pts);
+    if (r != ES_OK)
+      return r;
+    if (is_av1)
+    {
+      r = index_obus(b, data, size, pos + IVF_FRAME_HEADER, 0, &frame);
+      if (r != ES_OK)
+        return r;
+    }
+    else if ((r = unit_vcl(b, vpx_is_key(fourcc, data, size))) != ES_OK)
+    {
+      return r;
+    }
+    pos += IVF_FRAME_HEADER + size;
+  }
+
+  if (idx->count > 0)
+    idx->units[idx->count - 1].size = pos - idx->units[idx->count - 1].offset;
+  return ES_OK;
+}
+
+// ---------------------------------------------------------
+// Public: index
+// ---------------------------------------------------------
+int es_index_build(const char *path, int fps_num, int fps_den, es_index *out)
+{
+  if (!path || !out)
+    return ES_ERR_FORMAT;
+
+  memset(out, 0, sizeof(*out));
+  out->format = es_detect(path);
+  if (out->format == ES_FMT_NONE)
+    return ES_ERR_FORMAT;
+
+  // Frame-indexed timing: one tick per frame
+  out->tb_num = fps_num > 0 ? (fps_den > 0 ? fps_den : 1) : 1;
+  out->tb_den = fps_num > 0 ? fps_num : ES_DEFAULT_FPS;
+
+  out->path = strdup(path);
+  if (!out->path)
+    return ES_ERR_NOMEM;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    es_index_free(out);
+    return ES_ERR_OPEN;
+  }
+
+  struct stat stbuf;
+  if (fstat(fd, &stbuf) != 0 || stbuf.st_size <= 0)
+  {
+    close(fd);
+    es_index_free(out);
+    return ES_ERR_FORMAT;
+  }
+  out->file_size = stbuf.st_size;
+
+  void *map = mmap(NULL, (size_t)out->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    es_index_free(out);
+    return ES_ERR_IO;
+  }
+
+  es_builder b;
+  memset(&b, 0, sizeof(b));
+  b.idx = out;
+
+  int r;
+  int64_t frame = 0;
+  switch (out->format)
+  {
+  case ES_FMT_IVF:
+    r = index_ivf(&b, map, out->file_size);
+    break;
+  case ES_FMT_OBU:
+    r = index_obus(&b, map, out->file_size, 0, 1, &frame);
+    if (r == ES_OK && out->count > 0)
+      out->units[out->count - 1].size = out->file_size - out->units[out->count - 1].offset;
+    break;
+  default:
+    r = index_annexb(&b, map, out->file_size);
+    break;
+  }
+  munmap(map, (size_t)out->file_size);
+
+  if (r == ES_OK && out->count == 0)
+    r = ES_ERR_FORMAT;
+  if (r != ES_OK)
+    es_index_free(out);
+  return r;
+}
+
+static double unit_time(const es_index *idx, int64_t i)
+{
+  return (double)(idx->units[i].pts - idx->units[0].pts) * idx->tb_num / idx->tb_den;
+}
+
+int es_index_to_probe(const es_index *idx, sc_probe_result *out)
+{
+  if (!idx || !out || idx->count <= 0)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+  out->frames = calloc((size_t)idx->count, sizeof(*out->frames));
+  if (!out->frames)
+    return SC_ERR_NOMEM;
+  out->count = idx->count;
+  out->capacity = idx->count;
+
+  for (int64_t i = 0; i < idx->count; i++)
+  {
+    sc_frame_meta *fm = &out->frames[i];
+    fm->pts_time = unit_time(idx, i);
+    fm->is_keyframe = idx->units[i].key;
+    fm->pkt_size = idx->units[i].size;
+    fm->pict_type = idx->units[i].key ? 1 : 0;
+    fm->frame_span = 1;
+  }
+
+  // One frame past the last timestamp
+  double last = unit_time(idx, idx->count - 1);
+  double frame_dur = idx->count > 1 ? last / (double)(idx->count - 1)
+                                    : (double)idx->tb_num / idx->tb_den;
+  out->duration = last + frame_dur;
+  return SC_OK;
+}
+
+// ---------------------------------------------------------
+// Split: byte-range copies
+// ---------------------------------------------------------
+static int write_unit(const es_index *idx, const es_unit *u, int with_params,
+                      int in, int out, uint8_t *buf)
+{
+  const es_params *ps = (with_params && !u->has_params && u->params >= 0)
+                            ? &idx->params[u->params]
+                            : NULL;
+  if (!ps)
+    return rangeio_copy(in, out, u->offset, u->size, buf) == RANGEIO_OK ? ES_OK : ES_ERR_IO;
+
+  int64_t ps_len = 0;
+  for (int s = 0; s < ES_PARAM_SLOTS; s++)
+    ps_len += ps->nal[s].size;
+
+  int64_t off = u->offset;
+  int64_t len = u->size;
+  if (idx->format == ES_FMT_IVF)
+  {
+    // The frame grows by the inserted sequence header
+    uint8_t fh[IVF_FRAME_HEADER];
+    if (pread(in, fh, sizeof(fh), (off_t)off) != (ssize_t)sizeof(fh))
+      return ES_ERR_IO;
+    put_le32(fh, (uint32_t)(u->size - IVF_FRAME_HEADER + ps_len));
+    if (rangeio_write_full(out, fh, sizeof(fh)) != RANGEIO_OK)
+      return ES_ERR_IO;
+    off += IVF_FRAME_HEADER;
+    len -= IVF_FRAME_HEADER;
+  }
+
+  // Delimiter first, then the parameter sets, then the rest of the unit
+  int r = rangeio_copy(in, out, off, u->prefix_len, buf);
+  for (int s = 0; s < ES_PARAM_SLOTS && r == RANGEIO_OK; s++)
+    r = rangeio_copy(in, out, ps->nal[s].offset, ps->nal[s].size, buf);
+  if (r == RANGEIO_OK)
+    r = rangeio_copy(in, out, off + u->prefix_len, len - u->prefix_len, buf);
+  return r == RANGEIO_OK ? ES_OK : ES_ERR_IO;
+}
+
+int es_split_chunk(const es_index *idx, const sc_chunk *chunk, int last,
+                   const char *outpath)
+{
+  if (!idx || !chunk || !outpath || idx->count <= 0)
+    return ES_ERR_FORMAT;
+
+  int64_t first = 0;
+  while (first < idx->count && unit_time(idx, first) < chunk->start - EPS)
+    first++;
+  int64_t end = first;
+  while (end < idx->count && (last || unit_time(idx, end) < chunk->end - EPS))
+    end++;
+
+  int in = open(idx->path, O_RDONLY);
+  if (in < 0)
+    return ES_ERR_OPEN;
+  int out = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+  {
+    close(in);
+    return ES_ERR_OPEN;
+  }
+
+  int r = ES_OK;
+  uint8_t *buf = malloc(RANGEIO_BUFSIZE);
+  if (!buf)
+  {
+    r = ES_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  if (idx->format == ES_FMT_IVF)
+  {
+    uint8_t hdr[IVF_HEADER_SIZE];
+    memcpy(hdr, idx->ivf_header, sizeof(hdr));
+    hdr[6] = IVF_HEADER_SIZE;
+    hdr[7] = 0;
+    put_le32(hdr + 24, (uint32_t)(end - first));
+    if (rangeio_write_full(out, hdr, sizeof(hdr)) != RANGEIO_OK)
+    {
+      r = ES_ERR_IO;
+      goto cleanup;
+    }
+  }
+
+  for (int64_t i = first; i < end && r == ES_OK; i++)
+    r = write_unit(idx, &idx->units[i], i == first, in, out, buf);
+
+cleanup:
+  free(buf);
+  close(in);
+  if (close(out) != 0 && r == ES_OK)
+    r = ES_ERR_IO;
+  return r;
+}
+
+int es_split_all(const es_index *idx, const sc_chunk_plan *plan,
+                 const char *outdir)
+{
+  if (!idx || !plan || !outdir)
+    return ES_ERR_FORMAT;
+
+  const char *ext = es_format_ext(idx->format);
+  char outpath[1024];
+  for (int i = 0; i < plan->count; i++)
+  {
+    const sc_chunk *c = &plan->chunks[i];
+    if (snprintf(outpath, sizeof(outpath), "%s/chunk_%04d.%s",
+                 outdir, c->index, ext) >= (int)sizeof(outpath))
+      return ES_ERR_OPEN;
+
+    fprintf(stderr, "[split] %s (%.3f → %.3f) [es]\n", outpath, c->start, c->end);
+    int r = es_split_chunk(idx, c, i + 1 == plan->count, outpath);
+    if (r != ES_OK)
+      return r;
+  }
+  return ES_OK;
+}
+
+void es_index_free(es_index *idx)
+{
+  if (!idx)
+    return;
+  free(idx->path);
+  free(idx->units);
+  free(idx->params);
+  memset(idx, 0, sizeof(*idx));
+}
@@ -0,0 +1,114 @@
+#ifndef ESINPUT_H
+#define ESINPUT_H
+
+#include "smartchunk.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raw elementary-stream inputs (Annex-B H.264/HEVC, IVF, AV1 OBU).
+ * These carry no container index, so one parser pass records every
+ * access unit's byte range, keyframe flag and the parameter sets in
+ * force. Chunks are then written as byte-range copies at access-unit
+ * boundaries. No muxer is involved. The parameter sets are prepended when a
+ * chunk's first keyframe does not repeat them.
+ *
+ * Timestamps: IVF frames carry their own. Annex-B and OBU streams are
+ * timed as frame_index / fps, so cut times are in decode order.
+ */
+
+enum
+{
+    ES_OK = 0,
+    ES_ERR_OPEN = -70,
+    ES_ERR_IO = -71,
+    ES_ERR_FORMAT = -72,
+    ES_ERR_NOMEM = -73
+};
+
+typedef enum
+{
+    ES_FMT_NONE = 0,
+    ES_FMT_H264,
+    ES_FMT_HEVC,
+    ES_FMT_IVF,
+    ES_FMT_OBU
+} es_format;
+
+#define ES_DEFAULT_FPS 25
+
+/* Latest VPS/SPS/PPS (AV1: sequence header in slot 1); size 0 = absent */
+#define ES_PARAM_SLOTS 3
+
+typedef struct
+{
+    int64_t offset;
+    int64_t size;
+} es_range;
+
+typedef struct
+{
+    es_range nal[ES_PARAM_SLOTS];
+} es_params;
+
+typedef struct
+{
+    int64_t offset;  /* first byte (IVF: the 12-byte frame header) */
+    int64_t size;
+    int64_t pts;     /* IVF: frame timestamp; otherwise decode index */
+    int prefix_len;  /* leading AUD / temporal delimiter, kept first */
+    int key;         /* IDR / BLA / key frame: a cut point */
+    int has_params;  /* the unit repeats its parameter sets itself */
+    int params;      /* index into es_index.params, -1 = none */
+} es_unit;
+
+typedef struct
+{
+    es_format format;
+    char *path;
+    int64_t file_size;
+    int tb_num;              /* seconds per pts tick = tb_num / tb_den */
+    int tb_den;
+    uint8_t ivf_header[32];
+
+    es_unit *units;
+    int64_t count;
+    int64_t capacity;
+
+    es_params *params;
+    int param_count;
+    int param_capacity;
+} es_index;
+
+/* Format from the file extension (IVF confirmed by its signature) */
+es_format es_detect(const char *path);
+
+/* File extension for chunks of this format */
+const char *es_format_ext(es_format fmt);
+
+/* Index every access unit; fps (num/den, 0 = ES_DEFAULT_FPS) times
+   Annex-B and OBU streams */
+int es_index_build(const char *path, int fps_num, int fps_den, es_index *out);
+
+/* Frame list for the planner, one entry per access unit */
+int es_index_to_probe(const es_index *idx, sc_probe_result *out);
+
+/* Write the units in [chunk->start, chunk->end) to outpath */
+int es_split_chunk(const es_index *idx, const sc_chunk *chunk, int last,
+                   const char *outpath);
+
+/* Every chunk of the plan as <outdir>/chunk_NNNN.<ext> */
+int es_split_all(const es_index *idx, const sc_chunk_plan *plan,
+                 const char *outdir);
+
+void es_index_free(es_index *idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESINPUT_H */
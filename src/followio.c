@@ -0,0 +1,166 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L /* nanosleep/clock_gettime */
+#endif
+
+#include "followio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+
+#define FOLLOW_IO_BUFSIZE (64 * 1024)
+#define FOLLOW_POLL_MS 200
+
+typedef struct
+{
+  int fd;
+  char *done_path;    /* writer's end-of-stream marker */
+  double idle_timeout;
+  double last_growth; /* monotonic seconds of the last successful read */
+} follow_src;
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(int ms)
+{
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+// ---------------------------------------------------------
+// Read: block at EOF until the writer appends or finishes
+// ---------------------------------------------------------
+static int follow_read(void *opaque, uint8_t *buf, int buf_size)
+{
+  follow_src *s = opaque;
+
+  for (;;)
+  {
+    ssize_t n = read(s->fd, buf, (size_t)buf_size);
+    if (n > 0)
+    {
+      s->last_growth = now_sec();
+      return (int)n;
+    }
+    if (n < 0 && errno != EINTR && errno != EAGAIN)
+      return AVERROR(errno);
+    if (n < 0)
+      continue;
+
+    // At the current end: check the marker before waiting, then read
+    // once more so bytes written just before the marker are not lost
+    if (access(s->done_path, F_OK) == 0)
+    {
+      n = read(s->fd, buf, (size_t)buf_size);
+      if (n > 0)
+        return (int)n;
+      return AVERROR_EOF;
+    }
+
+    if (now_sec() - s->last_growth >= s->idle_timeout)
+      return AVERROR_EOF;
+
+    sleep_ms(FOLLOW_POLL_MS);
+  }
+}
+
+static void follow_src_free(follow_src *s)
+{
+  if (!s)
+    return;
+  if (s->fd >= 0)
+    close(s->fd);
+  free(s->done_path);
+  free(s);
+}
+
+int followio_open(const char *path, double idle_timeout,
+                  AVFormatContext **ctx)
+{
+  if (!path || !ctx)
+    return FOLLOW_ERR_OPEN;
+
+  follow_src *s = calloc(1, sizeof(*s));
+  if (!s)
+    return FOLLOW_ERR_NOMEM;
+
+  size_t len = strlen(path) + sizeof(FOLLOW_DONE_SUFFIX);
+  s->done_path = malloc(len);
+  if (!s->done_path)
+  {
+    free(s);
+    return FOLLOW_ERR_NOMEM;
+  }
+  snprintf(s->done_path, len, "%s%s", path, FOLLOW_DONE_SUFFIX);
+
+  s->fd = open(path, O_RDONLY);
+  if (s->fd < 0)
+  {
+    s->fd = -1;
+    follow_src_free(s);
+    return FOLLOW_ERR_OPEN;
+  }
+  s->idle_timeout = idle_timeout > 0.0 ? idle_timeout : FOLLOW_DEFAULT_IDLE;
+  s->last_growth = now_sec();
+
+  uint8_t *buf = av_malloc(FOLLOW_IO_BUFSIZE);
+  AVIOContext *pb = buf ? avio_alloc_context(buf, FOLLOW_IO_BUFSIZE, 0, s,
+                                             follow_read, NULL, NULL)
+                        : NULL;
+  if (!pb)
+  {
+    av_free(buf);
+    follow_src_free(s);
+    return FOLLOW_ERR_NOMEM;
+  }
+  pb->seekable = 0;
+
+  *ctx = avformat_alloc_context();
+  if (!*ctx)
+  {
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+    follow_src_free(s);
+    return FOLLOW_ERR_NOMEM;
+  }
+  (*ctx)->pb = pb;
+  (*ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+  // The path is passed along so its extension (.ts / .mp4) still helps
+  // the probe while only a few KB of the recording exist
+  if (avformat_open_input(ctx, path, NULL, NULL) < 0)
+  {
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+    follow_src_free(s);
+    return FOLLOW_ERR_FFMPEG;
+  }
+  return FOLLOW_OK;
+}
+
+void followio_close(AVFormatContext **ctx)
+{
+  if (!ctx || !*ctx)
+    return;
+
+  AVIOContext *pb = (*ctx)->pb;
+  avformat_close_input(ctx);
+  if (pb)
+  {
+    follow_src_free(pb->opaque);
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef FOLLOWIO_H
+#define FOLLOWIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Follow input: demux a file that is still being written (live TS or
+ * fMP4 recordings). Reads that hit the current end of file wait for the
+ * writer instead of ending the stream. The stream ends when
+ *
+ *   - "<path>.done" exists and everything before it has been read, or
+ *   - the file has not grown for idle_timeout seconds.
+ *
+ * The AVIO is not seekable, so demuxers never look for an index at the
+ * end of a file that does not have one yet.
+ */
+
+enum
+{
+    FOLLOW_OK = 0,
+    FOLLOW_ERR_OPEN = -60,
+    FOLLOW_ERR_NOMEM = -61,
+    FOLLOW_ERR_FFMPEG = -62
+};
+
+#define FOLLOW_DONE_SUFFIX ".done"
+#define FOLLOW_DEFAULT_IDLE 10.0
+
+struct AVFormatContext;
+
+int followio_open(const char *path, double idle_timeout,
+                  struct AVFormatContext **ctx);
+void followio_close(struct AVFormatContext **ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FOLLOWIO_H */
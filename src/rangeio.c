@@ -0,0 +1,71 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* copy_file_range */
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L /* pread */
+#endif
+
+#include "rangeio.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int rangeio_write_full(int fd, const uint8_t *buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return RANGEIO_ERR_IO;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return RANGEIO_OK;
+}
+
+int rangeio_copy(int in, int out, int64_t off, int64_t len, uint8_t *buf)
+{
+#ifdef __linux__
+  // In-kernel (reflink/server-side where the filesystem supports it)
+  loff_t in_off = off;
+  while (len > 0)
+  {
+    ssize_t n = copy_file_range(in, &in_off, out, NULL, (size_t)len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // EXDEV/ENOSYS/EINVAL: finish with read/write
+    len -= n;
+  }
+  off = in_off;
+  if (len == 0)
+    return RANGEIO_OK;
+#endif
+
+  uint8_t *own = NULL;
+  if (!buf && !(buf = own = malloc(RANGEIO_BUFSIZE)))
+    return RANGEIO_ERR_NOMEM;
+
+  int r = RANGEIO_OK;
+  while (len > 0 && r == RANGEIO_OK)
+  {
+    size_t want = len > RANGEIO_BUFSIZE ? RANGEIO_BUFSIZE : (size_t)len;
+    ssize_t n = pread(in, buf, want, (off_t)off);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      r = RANGEIO_ERR_IO;
+      break;
+    }
+    r = rangeio_write_full(out, buf, (size_t)n);
+    off += n;
+    len -= n;
+  }
+
+  free(own);
+  return r;
+}
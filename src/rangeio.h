@@ -0,0 +1,39 @@
+#ifndef RANGEIO_H
+#define RANGEIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Byte-range copies between file descriptors, shared by the raw ES
+ * and Y4M splitters. A range is copied in the kernel (copy_file_range
+ * on Linux, which reflinks where the filesystem can) and falls back to
+ * pread/write through a RANGEIO_BUFSIZE buffer. Output goes to the
+ * current position of the output descriptor.
+ */
+
+enum
+{
+    RANGEIO_OK = 0,
+    RANGEIO_ERR_IO = -90,
+    RANGEIO_ERR_NOMEM = -91
+};
+
+#define RANGEIO_BUFSIZE (1024 * 1024)
+
+/* write() until all of buf is out */
+int rangeio_write_full(int fd, const uint8_t *buf, size_t len);
+
+/* Copy [off, off + len) of in to out. buf holds RANGEIO_BUFSIZE bytes
+ * for the fallback, or is NULL to have one allocated when needed. */
+int rangeio_copy(int in, int out, int64_t off, int64_t len, uint8_t *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RANGEIO_H */
@@ -1,7 +1,12 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L /* strdup */
+#endif
+
 #include "smartchunk.h"
 
 #include <float.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,6 +19,13 @@ static const double EPS = 1e-6;
 // Scene detection threshold: ratio of size change indicating scene cut
 static const double DEFAULT_SCENE_THRESHOLD = 0.35;
 
+// Frames either side of a keyframe compared by the scene detector
+#define SCENE_WINDOW 5
+
+// Keyframe spacing the content-defined mask is sized for. Fixed, so the
+// mask depends on target/min only and never on the file being cut
+static const double CDC_NOMINAL_GOP = 2.0;
+
 // Frame type constants
 #define PICT_TYPE_I 1
 #define PICT_TYPE_P 2
@@ -36,16 +48,16 @@ static double packet_end(const AVPacket *pkt, AVRational tb, double pts)
   return pts;
 }
 
-static int ensure_frame_capacity(sc_probe_result *out, int needed)
+static int ensure_frame_capacity(sc_probe_result *out, int64_t needed)
 {
   if (needed <= out->capacity)
     return SC_OK;
 
-  int newcap = out->capacity ? out->capacity * 2 : 2048;
+  int64_t newcap = out->capacity ? out->capacity * 2 : 2048;
   if (newcap < needed)
     newcap = needed;
 
-  sc_frame_meta *frames = realloc(out->frames, newcap * sizeof(*frames));
+  sc_frame_meta *frames = realloc(out->frames, (size_t)newcap * sizeof(*frames));
   if (!frames)
     return SC_ERR_NOMEM;
 
@@ -75,12 +87,47 @@ static int ensure_chunk_capacity(sc_chunk_plan *plan, int needed)
 /* ------------------------------------------------------------------ */
 /* Packet-level probe (no decoding)                                   */
 /* ------------------------------------------------------------------ */
+static int probe_packets(const char *filename, int flags, double from, double to,
+                         sc_probe_result *out);
+
 int sc_probe_video(const char *filename, sc_probe_result *out)
+{
+  return sc_probe_video_ex(filename, 0, out);
+}
+
+int sc_probe_video_ex(const char *filename, int flags, sc_probe_result *out)
 {
   if (!filename || !out)
     return SC_ERR_INVAL;
 
+  if (flags & SC_PROBE_NATIVE_TS)
+  {
+    int r = sc_probe_ts(filename, flags, out);
+    if (r != SC_ERR_INVAL)
+      return r;
+  }
+
+  return probe_packets(filename, flags, -INFINITY, INFINITY, out);
+}
+
+int sc_probe_range(const char *filename, int flags, double from, double to,
+                   sc_probe_result *out)
+{
+  if (!filename || !out || !(to > from))
+    return SC_ERR_INVAL;
+  return probe_packets(filename, flags & ~SC_PROBE_NATIVE_TS, fmax(from, 0.0), to, out);
+}
+
+// Demux pass behind sc_probe_video_ex / sc_probe_range. A finite from
+// seeks to the keyframe at or before it and drops earlier frames; the
+// pass ends at the first keyframe at or after to. Times in out are then
+// relative to from (out->time_offset).
+static int probe_packets(const char *filename, int flags, double from, double to,
+                         sc_probe_result *out)
+{
   memset(out, 0, sizeof(*out));
+  const int keyframes_only = (flags & SC_PROBE_KEYFRAMES_ONLY) != 0;
+  out->keyframes_only = keyframes_only;
 
   AVFormatContext *fmt = NULL;
   if (avformat_open_input(&fmt, filename, NULL, NULL) < 0)
@@ -92,6 +139,12 @@ int sc_probe_video(const char *filename, sc_probe_result *out)
   }
 
   int vstream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  int audio = 0;
+  if (vstream < 0 && (flags & SC_PROBE_AUDIO))
+  {
+    vstream = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    audio = vstream >= 0;
+  }
   if (vstream < 0)
   {
     avformat_close_input(&fmt);
@@ -101,6 +154,18 @@ int sc_probe_video(const char *filename, sc_probe_result *out)
   AVStream *st = fmt->streams[vstream];
   AVRational tb = st->time_base;
 
+  const int ranged = isfinite(from);
+  if (ranged && av_seek_frame(fmt, vstream, (int64_t)(from / av_q2d(tb)), AVSEEK_FLAG_BACKWARD) < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_FFMPEG;
+  }
+
+  // AAC encoder delay, Opus pre-skip: samples before the real start
+  out->audio_only = audio;
+  if (audio && st->codecpar->initial_padding > 0 && st->codecpar->sample_rate > 0)
+    out->audio_priming = st->codecpar->initial_padding / (double)st->codecpar->sample_rate;
+
   AVPacket *pkt = av_packet_alloc();
   if (!pkt)
   {
@@ -115,46 +180,523 @@ int sc_probe_video(const char *filename, sc_probe_result *out)
     {
       double pts = packet_time(pkt, tb, best_end);
       double end = packet_end(pkt, tb, pts);
+      // Audio packets are whole codec frames: each one is a cut point
+      int is_key = (audio || (pkt->flags & AV_PKT_FLAG_KEY)) ? 1 : 0;
+
+      if (ranged && is_key && pts >= to)
+      {
+        av_packet_unref(pkt);
+        break;
+      }
+      if (ranged && (pts < from || pts >= to))
+      {
+        av_packet_unref(pkt);
+        continue;
+      }
+
+      if (end > best_end)
+        best_end = end;
+
+      // Keyframe-only: fold the frame into the open GOP's aggregate
+      if (keyframes_only && !is_key && out->count > 0)
+      {
+        sc_frame_meta *gop = &out->frames[out->count - 1];
+        gop->pkt_size += pkt->size;
+        gop->frame_span++;
+        if (pts < gop->pts_time - EPS)
+          gop->open_gop = 1;
+        av_packet_unref(pkt);
+        continue;
+      }
 
       if (ensure_frame_capacity(out, out->count + 1) != SC_OK)
       {
         av_packet_free(&pkt);
         avformat_close_input(&fmt);
+        sc_free_probe(out);
         return SC_ERR_NOMEM;
       }
 
       sc_frame_meta *fm = &out->frames[out->count++];
       fm->pts_time = pts;
-      fm->is_keyframe = (pkt->flags & AV_PKT_FLAG_KEY) ? 1 : 0;
+      fm->is_keyframe = is_key;
       fm->pkt_size = pkt->size;
+      fm->frame_span = 1;
+      fm->open_gop = 0;
 
       // Decode picture type from packet side data if available
       fm->pict_type = PICT_TYPE_UNKNOWN;
-      if (pkt->flags & AV_PKT_FLAG_KEY)
+      if (!audio && (pkt->flags & AV_PKT_FLAG_KEY))
         fm->pict_type = PICT_TYPE_I;
 
       // Initialize complexity and scene cut flags (computed later)
       fm->complexity = 0.0;
       fm->is_scene_cut = 0;
-
-      if (end > best_end)
-        best_end = end;
     }
     av_packet_unref(pkt);
   }
 
   av_packet_free(&pkt);
-  avformat_close_input(&fmt);
 
   if (best_end <= 0.0 && st->duration > 0)
     best_end = st->duration * av_q2d(tb);
   if (best_end <= 0.0 && fmt->duration > 0)
     best_end = fmt->duration / (double)AV_TIME_BASE;
 
+  avformat_close_input(&fmt);
+
   out->duration = best_end;
+  if (ranged)
+  {
+    // The planner works on [0, to - from); sc_plan_chunks shifts back
+    for (int64_t i = 0; i < out->count; i++)
+      out->frames[i].pts_time -= from;
+    out->duration = fmin(best_end, to) - from;
+    out->time_offset = from;
+    if (out->count == 0 || out->duration <= 0.0)
+    {
+      sc_free_probe(out);
+      return SC_ERR_INVAL;
+    }
+  }
+  return SC_OK;
+}
+
+/* ------------------------------------------------------------------ */
+/* Multi-file timeline                                                */
+/* ------------------------------------------------------------------ */
+int sc_probe_timeline(const char *const *filenames, int n, int flags,
+                      sc_probe_result *out, sc_timeline *tl)
+{
+  if (!filenames || n <= 0 || !out || !tl)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+  memset(tl, 0, sizeof(*tl));
+  tl->files = calloc((size_t)n, sizeof(*tl->files));
+  if (!tl->files)
+    return SC_ERR_NOMEM;
+
+  int r = SC_OK;
+  double offset = 0.0;
+  sc_probe_result part;
+  memset(&part, 0, sizeof(part));
+
+  for (int i = 0; i < n; i++)
+  {
+    if ((r = sc_probe_video_ex(filenames[i], flags, &part)) != SC_OK)
+      goto fail;
+    if (i > 0 && part.audio_only != out->audio_only)
+    {
+      r = SC_ERR_INVAL;
+      goto fail;
+    }
+
+    // File 0 keeps its own timeline; later files start at their first
+    // frame, so a gap or a restart at zero between files is dropped
+    double origin = 0.0;
+    if (i > 0 && part.count > 0)
+    {
+      origin = part.frames[0].pts_time;
+      for (int64_t k = 1; k < part.count; k++)
+        origin = fmin(origin, part.frames[k].pts_time);
+    }
+
+    sc_timeline_file *f = &tl->files[tl->count];
+    f->path = strdup(filenames[i]);
+    if (!f->path)
+    {
+      r = SC_ERR_NOMEM;
+      goto fail;
+    }
+    f->offset = offset;
+    f->origin = origin;
+    tl->count++;
+
+    if (ensure_frame_capacity(out, out->count + part.count) != SC_OK)
+    {
+      r = SC_ERR_NOMEM;
+      goto fail;
+    }
+    for (int64_t k = 0; k < part.count; k++)
+    {
+      sc_frame_meta fm = part.frames[k];
+      fm.pts_time += offset - origin;
+      out->frames[out->count++] = fm;
+    }
+
+    if (i == 0)
+    {
+      out->keyframes_only = part.keyframes_only;
+      out->audio_only = part.audio_only;
+      out->audio_priming = part.audio_priming;
+    }
+    offset += fmax(part.duration - origin, 0.0);
+    sc_free_probe(&part);
+  }
+
+  out->duration = offset;
+  return SC_OK;
+
+fail:
+  sc_free_probe(&part);
+  sc_free_probe(out);
+  sc_free_timeline(tl);
+  return r;
+}
+
+void sc_free_timeline(sc_timeline *tl)
+{
+  if (!tl)
+    return;
+  for (int i = 0; i < tl->count; i++)
+    free(tl->files[i].path);
+  free(tl->files);
+  memset(tl, 0, sizeof(*tl));
+}
+
+/* ------------------------------------------------------------------ */
+/* Sampled probe                                                      */
+/* ------------------------------------------------------------------ */
+typedef struct
+{
+  double time;
+  double mean_size;
+} size_sample;
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double interp_size(const size_sample *smp, int n, double t)
+{
+  if (n == 0)
+    return 0.0;
+  if (t <= smp[0].time)
+    return smp[0].mean_size;
+  for (int i = 1; i < n; i++)
+  {
+    if (t <= smp[i].time)
+    {
+      double w = (t - smp[i - 1].time) / fmax(smp[i].time - smp[i - 1].time, EPS);
+      return smp[i - 1].mean_size + w * (smp[i].mean_size - smp[i - 1].mean_size);
+    }
+  }
+  return smp[n - 1].mean_size;
+}
+
+// Add one GOP aggregate to a keyframe-only result
+static int push_gop(sc_probe_result *out, double t, int64_t bytes, int frames)
+{
+  if (ensure_frame_capacity(out, out->count + 1) != SC_OK)
+    return SC_ERR_NOMEM;
+
+  out->frames[out->count++] = (sc_frame_meta){
+      .pts_time = t,
+      .is_keyframe = 1,
+      .pkt_size = bytes,
+      .pict_type = PICT_TYPE_I,
+      .complexity = 0.0,
+      .is_scene_cut = 0,
+      .frame_span = frames > 0 ? frames : 1};
+  return SC_OK;
+}
+
+// Upper bound on a sampling burst, in multiples of burst_frames, for
+// streams whose GOPs are far longer than a burst
+#define SAMPLE_BURST_CAP 32
+
+// Containers that index every sample (MP4/MOV) give exact GOP sizes
+// without reading a single payload. Index times are decode times;
+// pts_shift moves keyframes onto the presentation timeline.
+static int gops_from_full_index(AVStream *st, int n_idx, double pts_shift,
+                                sc_probe_result *out)
+{
+  AVRational tb = st->time_base;
+  double t = 0.0;
+  int64_t bytes = 0;
+  int frames = 0;
+  int open = 0;
+
+  for (int i = 0; i < n_idx; i++)
+  {
+    const AVIndexEntry *e = avformat_index_get_entry(st, i);
+    if (!e)
+      continue;
+
+    if ((e->flags & AVINDEX_KEYFRAME) || !open)
+    {
+      if (open && push_gop(out, t, bytes, frames) != SC_OK)
+        return SC_ERR_NOMEM;
+      t = e->timestamp * av_q2d(tb) + pts_shift;
+      bytes = 0;
+      frames = 0;
+      open = 1;
+    }
+    bytes += e->size;
+    frames++;
+  }
+
+  if (open && push_gop(out, t, bytes, frames) != SC_OK)
+    return SC_ERR_NOMEM;
+
+  out->sample_error = 0.0;
   return SC_OK;
 }
 
+int sc_probe_sampled(const char *filename,
+                     double stride_sec,
+                     int burst_frames,
+                     sc_probe_result *out)
+{
+  if (!filename || !out)
+    return SC_ERR_INVAL;
+
+  if (stride_sec <= 0.0)
+    stride_sec = 60.0;
+  if (burst_frames <= 0)
+    burst_frames = 30;
+
+  memset(out, 0, sizeof(*out));
+  out->keyframes_only = 1;
+
+  AVFormatContext *fmt = NULL;
+  if (avformat_open_input(&fmt, filename, NULL, NULL) < 0)
+    return SC_ERR_FFMPEG;
+  if (avformat_find_stream_info(fmt, NULL) < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_FFMPEG;
+  }
+
+  int vstream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (vstream < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_NOSTREAM;
+  }
+
+  AVStream *st = fmt->streams[vstream];
+  AVRational tb = st->time_base;
+  int n_idx = avformat_index_get_entries_count(st);
+
+  // Without an index (MPEG-TS, raw streams) there is nothing to sample
+  // against: fall back to a full keyframe-only scan
+  if (n_idx <= 0)
+  {
+    avformat_close_input(&fmt);
+    return sc_probe_video_ex(filename, SC_PROBE_KEYFRAMES_ONLY, out);
+  }
+
+  double duration = 0.0;
+  if (st->duration > 0)
+    duration = st->duration * av_q2d(tb);
+  else if (fmt->duration > 0)
+    duration = fmt->duration / (double)AV_TIME_BASE;
+
+  int r = SC_OK;
+  AVPacket *pkt = av_packet_alloc();
+  size_sample *samples = NULL;
+  double *keys = NULL;
+  int sample_count = 0;
+  int key_count = 0;
+  int nonkey_entries = 0;
+
+  int max_samples = duration > 0.0 ? (int)(duration / stride_sec) + 2 : 2;
+  samples = malloc(sizeof(*samples) * max_samples);
+  keys = malloc(sizeof(*keys) * ((size_t)n_idx + (size_t)max_samples * (burst_frames + 1)));
+  if (!pkt || !samples || !keys)
+  {
+    r = SC_ERR_NOMEM;
+    goto done;
+  }
+
+  for (int i = 0; i < n_idx; i++)
+  {
+    const AVIndexEntry *e = avformat_index_get_entry(st, i);
+    if (!e)
+      continue;
+    if (e->flags & AVINDEX_KEYFRAME)
+      keys[key_count++] = e->timestamp * av_q2d(tb);
+    else
+      nonkey_entries++;
+  }
+
+  // Index times are decode times; the first packet's pts - dts maps
+  // them onto the presentation timeline the splitter cuts on
+  double pts_shift = 0.0;
+  while (av_read_frame(fmt, pkt) >= 0)
+  {
+    int is_video = pkt->stream_index == vstream;
+    if (is_video && pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE)
+      pts_shift = (pkt->pts - pkt->dts) * av_q2d(tb);
+    av_packet_unref(pkt);
+    if (is_video)
+      break;
+  }
+
+  // Every sample indexed: exact sizes straight from the index
+  if (nonkey_entries > 0)
+  {
+    r = gops_from_full_index(st, n_idx, pts_shift, out);
+    goto done;
+  }
+
+  const int index_keys = key_count;
+
+  // -----------------------------
+  // Bursts: whole GOPs every stride seconds. A burst opens on a
+  // keyframe and closes on one after burst_frames frames, so the
+  // I-frame share of its mean matches the stream's; a GOP still open
+  // after SAMPLE_BURST_CAP bursts' worth is closed where it stands.
+  // -----------------------------
+  double fps_frames = 0.0;
+  double fps_span = 0.0;
+
+  for (int s_i = 0; s_i < max_samples; s_i++)
+  {
+    double at = s_i * stride_sec;
+    if (duration > 0.0 && at >= duration)
+      break;
+
+    int64_t ts = (int64_t)(at / av_q2d(tb));
+    if (av_seek_frame(fmt, vstream, ts, AVSEEK_FLAG_BACKWARD) < 0)
+      break;
+
+    int64_t bytes = 0;
+    int frames = 0;
+    double first = -1.0;
+    double last = 0.0;
+
+    while (frames < burst_frames * SAMPLE_BURST_CAP && av_read_frame(fmt, pkt) >= 0)
+    {
+      if (pkt->stream_index != vstream)
+      {
+        av_packet_unref(pkt);
+        continue;
+      }
+
+      double pts = packet_time(pkt, tb, last);
+      int is_key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+      int size = pkt->size;
+      av_packet_unref(pkt);
+
+      // Frames ahead of the first keyframe belong to a GOP seen in part
+      if (first < 0.0 && !is_key)
+        continue;
+      if (is_key)
+      {
+        keys[key_count++] = pts;
+        if (frames >= burst_frames)
+          break;
+      }
+
+      if (first < 0.0)
+        first = pts;
+      if (pts > last)
+        last = pts;
+      bytes += size;
+      frames++;
+    }
+
+    if (frames == 0)
+      continue;
+
+    // A burst after a backward seek can start well before `at`
+    if (sample_count > 0 && first <= samples[sample_count - 1].time + EPS)
+      continue;
+
+    samples[sample_count++] = (size_sample){.time = first, .mean_size = (double)bytes / frames};
+    if (frames > 1 && last > first)
+    {
+      fps_frames += frames - 1;
+      fps_span += last - first;
+    }
+  }
+
+  if (sample_count == 0 || key_count == 0)
+  {
+    r = SC_ERR_FFMPEG;
+    goto done;
+  }
+
+  double fps = av_q2d(st->avg_frame_rate);
+  if (fps <= 0.0 && fps_span > 0.0)
+    fps = fps_frames / fps_span;
+  if (fps <= 0.0)
+    fps = 25.0;
+
+  // Sparse index keyframes (decode time) and burst keyframes (pts)
+  for (int i = 0; i < key_count; i++)
+    keys[i] += (i < index_keys) ? pts_shift : 0.0;
+  qsort(keys, key_count, sizeof(*keys), cmp_double);
+
+  if (duration <= 0.0)
+    duration = samples[sample_count - 1].time + burst_frames / fps;
+
+  for (int i = 0; i < key_count; i++)
+  {
+    if (i > 0 && keys[i] - keys[i - 1] < 1e-3)
+      continue;
+
+    double next = duration;
+    for (int j = i + 1; j < key_count; j++)
+    {
+      if (keys[j] - keys[i] >= 1e-3)
+      {
+        next = keys[j];
+        break;
+      }
+    }
+
+    int frames = (int)llround((next - keys[i]) * fps);
+    if (frames < 1)
+      frames = 1;
+    int64_t bytes = (int64_t)llround(interp_size(samples, sample_count, keys[i]) * frames);
+
+    r = push_gop(out, keys[i], bytes, frames);
+    if (r != SC_OK)
+      goto done;
+  }
+
+  // Leave-one-out: how well does interpolation predict a sample it did
+  // not see? Estimates the relative error of the GOP sizes above.
+  out->sample_error = -1.0;
+  if (sample_count >= 3)
+  {
+    double err = 0.0;
+    int n = 0;
+    for (int i = 1; i + 1 < sample_count; i++)
+    {
+      if (samples[i].mean_size <= 0.0)
+        continue;
+      double w = (samples[i].time - samples[i - 1].time) /
+                 fmax(samples[i + 1].time - samples[i - 1].time, EPS);
+      double pred = samples[i - 1].mean_size + w * (samples[i + 1].mean_size - samples[i - 1].mean_size);
+      err += fabs(pred - samples[i].mean_size) / samples[i].mean_size;
+      n++;
+    }
+    if (n > 0)
+      out->sample_error = err / n;
+  }
+
+done:
+  if (r == SC_OK)
+    out->duration = duration;
+  else
+    sc_free_probe(out);
+
+  free(samples);
+  free(keys);
+  if (pkt)
+    av_packet_free(&pkt);
+  avformat_close_input(&fmt);
+  return r;
+}
+
 void sc_free_probe(sc_probe_result *res)
 {
   if (!res)
@@ -177,7 +719,7 @@ static void compute_complexity(sc_probe_result *m)
   int64_t min_size = m->frames[0].pkt_size;
   int64_t max_size = m->frames[0].pkt_size;
 
-  for (int i = 1; i < m->count; i++)
+  for (int64_t i = 1; i < m->count; i++)
   {
     if (m->frames[i].pkt_size < min_size)
       min_size = m->frames[i].pkt_size;
@@ -190,12 +732,37 @@ static void compute_complexity(sc_probe_result *m)
     range = 1.0;
 
   // Normalize complexity scores
-  for (int i = 0; i < m->count; i++)
+  for (int64_t i = 0; i < m->count; i++)
   {
     m->frames[i].complexity = (double)(m->frames[i].pkt_size - min_size) / range;
   }
 }
 
+// Relative change in mean packet size across keyframe i (window frames
+// either side); 0 where the window does not fit
+static double scene_ratio(const sc_probe_result *m, int64_t i)
+{
+  const int window = SCENE_WINDOW;
+  if (i < window || i >= m->count - window)
+    return 0.0;
+
+  // Calculate average size before and after this frame
+  double avg_before = 0.0;
+  double avg_after = 0.0;
+
+  for (int64_t j = i - window; j < i; j++)
+    avg_before += m->frames[j].pkt_size;
+  avg_before /= window;
+
+  for (int64_t j = i; j < i + window && j < m->count; j++)
+    avg_after += m->frames[j].pkt_size;
+  avg_after /= window;
+
+  if (avg_before <= 0.0)
+    return 0.0;
+  return fabs(avg_after - avg_before) / avg_before;
+}
+
 // Detect scene changes based on packet size discontinuities
 static void detect_scene_changes(sc_probe_result *m, double threshold)
 {
@@ -206,83 +773,159 @@ static void detect_scene_changes(sc_probe_result *m, double threshold)
     threshold = DEFAULT_SCENE_THRESHOLD;
 
   // Use a sliding window to detect significant changes in packet sizes
-  const int window = 5;
-
-  for (int i = window; i < m->count - window; i++)
+  for (int64_t i = 0; i < m->count; i++)
   {
     // Only consider keyframes as potential scene cuts
     if (!m->frames[i].is_keyframe)
       continue;
 
-    // Calculate average size before and after this frame
-    double avg_before = 0.0;
-    double avg_after = 0.0;
-
-    for (int j = i - window; j < i; j++)
-      avg_before += m->frames[j].pkt_size;
-    avg_before /= window;
-
-    for (int j = i; j < i + window && j < m->count; j++)
-      avg_after += m->frames[j].pkt_size;
-    avg_after /= window;
-
-    // Check for significant change
-    double ratio = 0.0;
-    if (avg_before > 0.0)
-      ratio = fabs(avg_after - avg_before) / avg_before;
-
-    if (ratio > threshold)
+    if (scene_ratio(m, i) > threshold)
       m->frames[i].is_scene_cut = 1;
   }
 }
 
 /* ------------------------------------------------------------------ */
-/* Chunk planning helpers                                             */
+/* GOP table                                                          */
 /* ------------------------------------------------------------------ */
-// Collect potential cut points (keyframes or scene cuts)
-typedef struct
+static int ensure_gop_capacity(sc_gop_table *t, int64_t needed)
 {
-  double time;
-  int is_keyframe;
-  int is_scene_cut;
-  double complexity;
-  int quality_score;  // higher is better for cutting here
-} cut_point;
+  if (needed <= t->capacity)
+    return SC_OK;
 
-static int collect_cut_points(const sc_probe_result *m,
-                               cut_point **cuts_out,
-                               int *count_out,
-                               int use_scene_cuts)
-{
-  cut_point *cuts = malloc(sizeof(cut_point) * m->count);
-  if (!cuts)
+  int64_t newcap = t->capacity ? t->capacity * 2 : 256;
+  if (newcap < needed)
+    newcap = needed;
+
+  sc_gop *gops = realloc(t->gops, newcap * sizeof(*gops));
+  if (!gops)
     return SC_ERR_NOMEM;
 
-  int count = 0;
-  for (int i = 0; i < m->count; i++)
-  {
-    // Always include keyframes
-    if (m->frames[i].is_keyframe)
+  t->gops = gops;
+  t->capacity = newcap;
+  return SC_OK;
+}
+
+int sc_build_gop_table(const sc_probe_result *m, sc_gop_table *out)
+{
+  if (!m || !out)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+
+  sc_gop *g = NULL;
+  double complexity_sum = 0.0;
+
+  for (int64_t i = 0; i < m->count; i++)
+  {
+    const sc_frame_meta *f = &m->frames[i];
+    int span = f->frame_span > 0 ? f->frame_span : 1;
+
+    // Frames ahead of the first keyframe form a leading, uncuttable GOP
+    if (f->is_keyframe || !g)
     {
-      cuts[count].time = m->frames[i].pts_time;
-      cuts[count].is_keyframe = 1;
-      cuts[count].is_scene_cut = m->frames[i].is_scene_cut;
-      cuts[count].complexity = m->frames[i].complexity;
+      if (g)
+        g->cost = complexity_sum / g->frame_count;
 
-      // Score: prefer scene cuts at keyframes
-      cuts[count].quality_score = 100;
-      if (m->frames[i].is_scene_cut && use_scene_cuts)
-        cuts[count].quality_score += 50;
+      if (ensure_gop_capacity(out, out->count + 1) != SC_OK)
+      {
+        sc_free_gop_table(out);
+        return SC_ERR_NOMEM;
+      }
 
-      count++;
+      g = &out->gops[out->count++];
+      *g = (sc_gop){
+          .start = f->pts_time,
+          .first_frame = i,
+          .frame_count = 0,
+          .bytes = 0,
+          .cost = 0.0,
+          .is_keyframe = f->is_keyframe,
+          .closed = f->is_keyframe,
+          .is_scene_cut = f->is_scene_cut,
+          .scene_score = f->is_keyframe ? scene_ratio(m, i) : 0.0};
+      complexity_sum = 0.0;
     }
+
+    // Leading pictures shown before the keyframe reference the previous
+    // GOP: the packet-level sign of an open GOP. Keyframe-only probes
+    // fold them away and flag the aggregate instead.
+    if (g->is_keyframe && (f->pts_time < g->start - EPS || f->open_gop))
+      g->closed = 0;
+
+    g->frame_count += span;
+    g->bytes += f->pkt_size;
+    complexity_sum += f->complexity * span;
+  }
+
+  if (g)
+    g->cost = complexity_sum / g->frame_count;
+
+  return SC_OK;
+}
+
+void sc_free_gop_table(sc_gop_table *t)
+{
+  if (!t)
+    return;
+  free(t->gops);
+  memset(t, 0, sizeof(*t));
+}
+
+/* ------------------------------------------------------------------ */
+/* Chunk planning helpers                                             */
+/* ------------------------------------------------------------------ */
+// Collect potential cut points (keyframes or scene cuts)
+typedef struct
+{
+  double time;
+  int is_keyframe;
+  int is_scene_cut;
+  double complexity;
+  int quality_score;  // higher is better for cutting here
+} cut_point;
+
+static int collect_cut_points(const sc_gop_table *gt,
+                               cut_point **cuts_out,
+                               int64_t *count_out,
+                               int use_scene_cuts,
+                               int prefer_closed)
+{
+  *cuts_out = NULL;
+  *count_out = 0;
+  if (gt->count == 0)
+    return SC_OK;
+
+  cut_point *cuts = malloc(sizeof(cut_point) * gt->count);
+  if (!cuts)
+    return SC_ERR_NOMEM;
+
+  int64_t count = 0;
+  for (int64_t i = 0; i < gt->count; i++)
+  {
+    const sc_gop *g = &gt->gops[i];
+
+    // Every GOP that opens on a keyframe is a cut point
+    if (!g->is_keyframe)
+      continue;
+
+    cuts[count].time = g->start;
+    cuts[count].is_keyframe = 1;
+    cuts[count].is_scene_cut = g->is_scene_cut;
+    cuts[count].complexity = g->cost;
+
+    // Score: prefer scene cuts at keyframes
+    cuts[count].quality_score = 100;
+    if (g->is_scene_cut && use_scene_cuts)
+      cuts[count].quality_score += 50;
+    if (g->closed && prefer_closed)
+      cuts[count].quality_score += 25;
+
+    count++;
   }
 
   if (count == 0)
   {
     free(cuts);
-    *cuts_out = NULL;
-    *count_out = 0;
     return SC_OK;
   }
 
@@ -292,14 +935,14 @@ static int collect_cut_points(const sc_probe_result *m,
 }
 
 // Legacy function for compatibility
-static int collect_keyframes(const sc_probe_result *m,
+static int collect_keyframes(const sc_gop_table *gt,
                              double **times_out,
-                             int *count_out)
+                             int64_t *count_out)
 {
   cut_point *cuts = NULL;
-  int cut_count = 0;
+  int64_t cut_count = 0;
 
-  int r = collect_cut_points(m, &cuts, &cut_count, 0);
+  int r = collect_cut_points(gt, &cuts, &cut_count, 0, 0);
   if (r != SC_OK)
     return r;
 
@@ -317,7 +960,7 @@ static int collect_keyframes(const sc_probe_result *m,
     return SC_ERR_NOMEM;
   }
 
-  for (int i = 0; i < cut_count; i++)
+  for (int64_t i = 0; i < cut_count; i++)
     times[i] = cuts[i].time;
 
   free(cuts);
@@ -326,9 +969,9 @@ static int collect_keyframes(const sc_probe_result *m,
   return SC_OK;
 }
 
-// Calculate chunk statistics from probe data
+// Calculate chunk statistics from the GOPs starting in [start, end)
 static void compute_chunk_stats(sc_chunk *chunk,
-                                 const sc_probe_result *m,
+                                 const sc_gop_table *gt,
                                  double start,
                                  double end)
 {
@@ -337,22 +980,22 @@ static void compute_chunk_stats(sc_chunk *chunk,
   chunk->scene_cut_count = 0;
   chunk->quality_score = 0.0;
 
-  int frame_count = 0;
+  int64_t frame_count = 0;
   double total_complexity = 0.0;
 
-  for (int i = 0; i < m->count; i++)
+  for (int64_t i = 0; i < gt->count; i++)
   {
-    double t = m->frames[i].pts_time;
-    if (t >= start - EPS && t < end + EPS)
-    {
-      frame_count++;
-      total_complexity += m->frames[i].complexity;
+    const sc_gop *g = &gt->gops[i];
+    if (g->start < start - EPS || g->start >= end - EPS)
+      continue;
 
-      if (m->frames[i].is_keyframe)
-        chunk->keyframe_count++;
-      if (m->frames[i].is_scene_cut)
-        chunk->scene_cut_count++;
-    }
+    frame_count += g->frame_count;
+    total_complexity += g->cost * g->frame_count;
+
+    if (g->is_keyframe)
+      chunk->keyframe_count++;
+    if (g->is_scene_cut)
+      chunk->scene_cut_count++;
   }
 
   if (frame_count > 0)
@@ -386,6 +1029,61 @@ static int append_chunk(sc_chunk_plan *plan,
   return SC_OK;
 }
 
+// Size objective: bytes of the GOPs between two cut times, from prefix
+// sums over the GOP table
+typedef struct
+{
+  const sc_gop_table *gt;
+  int64_t *prefix;      // prefix[i] = bytes of gops[0 .. i)
+  int64_t target_bytes; // 0 = duration only
+  double weight;        // share of the size term in the score (0-1)
+} byte_target;
+
+static int64_t bytes_before(const byte_target *bt, double t)
+{
+  int64_t lo = 0, hi = bt->gt->count;
+  while (lo < hi)
+  {
+    int64_t mid = lo + (hi - lo) / 2;
+    if (bt->gt->gops[mid].start < t - EPS)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return bt->prefix[lo];
+}
+
+static int byte_target_init(byte_target *bt, const sc_gop_table *gt, sc_plan_config cfg)
+{
+  memset(bt, 0, sizeof(*bt));
+  bt->gt = gt;
+  bt->prefix = malloc(sizeof(int64_t) * (gt->count + 1));
+  if (!bt->prefix)
+    return SC_ERR_NOMEM;
+  bt->prefix[0] = 0;
+  for (int64_t i = 0; i < gt->count; i++)
+    bt->prefix[i + 1] = bt->prefix[i] + gt->gops[i].bytes;
+
+  if (cfg.target_bytes > 0)
+  {
+    bt->target_bytes = cfg.target_bytes;
+    bt->weight = cfg.bytes_weight < 0.0 ? 1.0 : fmin(cfg.bytes_weight, 1.0);
+  }
+  return SC_OK;
+}
+
+// Distance of a [start, t) chunk from the target, relative to it:
+// duration, size, or the weighted blend of both
+static double target_distance(const byte_target *bt, double start, double t, double target)
+{
+  double d = fabs((t - start) - target) / target;
+  if (!bt || bt->target_bytes <= 0)
+    return d;
+  double bytes = (double)(bytes_before(bt, t) - bytes_before(bt, start));
+  double b = fabs(bytes - (double)bt->target_bytes) / (double)bt->target_bytes;
+  return d * (1.0 - bt->weight) + b * bt->weight;
+}
+
 // Smart cut selection considering quality, scenes, and complexity
 static double choose_smart_cut(double start,
                                 double duration,
@@ -393,15 +1091,16 @@ static double choose_smart_cut(double start,
                                 double min_dur,
                                 double max_dur,
                                 const cut_point *cuts,
-                                int cut_count,
-                                int *cursor,
-                                double complexity_weight)
+                                int64_t cut_count,
+                                int64_t *cursor,
+                                double complexity_weight,
+                                const byte_target *bt)
 {
   double best_cut = -1.0;
   double best_score = DBL_MAX;
   double fallback = -1.0;
 
-  int idx = *cursor;
+  int64_t idx = *cursor;
   while (idx < cut_count && cuts[idx].time <= start + EPS)
     idx++;
 
@@ -425,8 +1124,8 @@ static double choose_smart_cut(double start,
     }
 
     // Multi-factor scoring:
-    // 1. Distance from target duration
-    double duration_score = fabs(span - target) / target;
+    // 1. Distance from target duration (and/or size)
+    double duration_score = target_distance(bt, start, t, target);
 
     // 2. Scene cut bonus (lower is better)
     double scene_bonus = cuts[idx].is_scene_cut ? -0.3 : 0.0;
@@ -471,14 +1170,15 @@ static double choose_cut(double start,
                          double min_dur,
                          double max_dur,
                          const double *key_times,
-                         int key_count,
-                         int *cursor)
+                         int64_t key_count,
+                         int64_t *cursor,
+                         const byte_target *bt)
 {
   double best_cut = -1.0;
   double best_score = DBL_MAX;
   double fallback = -1.0;
 
-  int idx = *cursor;
+  int64_t idx = *cursor;
   while (idx < key_count && key_times[idx] <= start + EPS)
     idx++;
 
@@ -501,7 +1201,8 @@ static double choose_cut(double start,
       break;
     }
 
-    double score = fabs(span - target);
+    double score = bt && bt->target_bytes > 0 ? target_distance(bt, start, t, target)
+                                              : fabs(span - target);
     if (score < best_score)
     {
       best_score = score;
@@ -538,6 +1239,17 @@ static void merge_tiny_tail(sc_chunk_plan *plan, double min_dur, double duration
 
   if ((last->end - last->start) < (min_dur * 0.5))
   {
+    // The online planner has no GOP table to recompute stats from, so
+    // the tail's are folded in (complexity weighted by duration)
+    double prev_dur = prev->end - prev->start;
+    double last_dur = last->end - last->start;
+    if (prev_dur + last_dur > 0.0)
+      prev->avg_complexity = (prev->avg_complexity * prev_dur +
+                              last->avg_complexity * last_dur) /
+                             (prev_dur + last_dur);
+    prev->keyframe_count += last->keyframe_count;
+    prev->scene_cut_count += last->scene_cut_count;
+    prev->bytes += last->bytes;
     prev->end = duration;
     plan->count--;
   }
@@ -550,34 +1262,233 @@ static void renumber_chunks(sc_chunk_plan *plan)
 }
 
 /* ------------------------------------------------------------------ */
-/* Public chunk planner                                               */
+/* Content-defined cut points                                         */
 /* ------------------------------------------------------------------ */
-int sc_plan_chunks(const sc_probe_result *meta,
-                   sc_plan_config cfg,
-                   sc_chunk_plan *out)
+// splitmix64 finaliser, used as the per-frame gear value
+static uint64_t mix64(uint64_t x)
 {
-  if (!meta || !out || meta->count == 0 || meta->duration <= 0.0)
-    return SC_ERR_INVAL;
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
 
-  memset(out, 0, sizeof(*out));
+// A keyframe is a content-defined boundary when the low bits of the
+// rolling hash are zero. Before target a stricter mask is used and
+// after it a looser one (FastCDC normalisation), which keeps spans
+// near target without making the decision depend on where the
+// previous cut was, beyond the min/max window.
+static int cdc_boundary(uint64_t hash, double span, double target, int bits)
+{
+  int b = span < target ? bits + 1 : (bits > 0 ? bits - 1 : 0);
+  uint64_t mask = b >= 63 ? ~0ULL : ((1ULL << b) - 1);
+  return (hash & mask) == 0;
+}
 
-  // Make a mutable copy of probe data for analysis
-  sc_probe_result m = *meta;
+// Cut where a gear hash over the recent packet sizes and keyframe
+// pattern says so. The hash only sees the last 64 frames and never
+// timestamps, so a re-delivery with an edit (new intro, trimmed
+// credits) reproduces the same boundaries once past the changed part,
+// and encodes cached per chunk stay valid.
+static int plan_content_defined(const sc_probe_result *m,
+                                const sc_gop_table *gt,
+                                double target,
+                                double min_dur,
+                                double max_dur,
+                                sc_chunk_plan *out)
+{
+  cut_point *cuts = NULL;
+  int64_t cut_count = 0;
+  int r = collect_cut_points(gt, &cuts, &cut_count, 0, 0);
+  if (r != SC_OK)
+    return r;
 
-  // Run smart analysis if enabled
-  if (cfg.enable_complexity_adapt || cfg.enable_scene_detection)
+  if (cut_count == 0)
   {
-    compute_complexity(&m);
+    free(cuts);
+    return append_chunk(out, 0, 0.0, m->duration);
   }
 
-  if (cfg.enable_scene_detection)
+  uint64_t *hashes = malloc(sizeof(uint64_t) * cut_count);
+  if (!hashes)
   {
-    detect_scene_changes(&m, cfg.scene_threshold);
+    free(cuts);
+    return SC_ERR_NOMEM;
+  }
+
+  uint64_t h = 0;
+  int64_t k = 0;
+  for (int64_t i = 0; i < m->count && k < cut_count; i++)
+  {
+    const sc_frame_meta *f = &m->frames[i];
+    h = (h << 1) + mix64((uint64_t)f->pkt_size ^ ((uint64_t)f->is_keyframe << 63));
+    if (f->is_keyframe)
+      hashes[k++] = h;
+  }
+
+  // Expected keyframes between min and a boundary ~ 2^bits. Whole-file
+  // statistics would let an edit anywhere move every boundary.
+  double span_kf = (target - min_dur) / CDC_NOMINAL_GOP;
+  int bits = span_kf > 1.0 ? (int)lround(log2(span_kf)) : 0;
+
+  double start = 0.0;
+  int64_t last_ok = -1;  // last keyframe inside [min, max] since start
+  int64_t last_key = -1; // last keyframe at all since start
+  int chunk_index = 0;
+
+  for (k = 0; k < cut_count; k++)
+  {
+    double t = cuts[k].time;
+    if (t <= start + EPS || t >= m->duration - EPS)
+      continue;
+
+    double span = t - start;
+    if (span < min_dur - EPS)
+    {
+      last_key = k;
+      continue;
+    }
+
+    if (span > max_dur + EPS)
+    {
+      // No boundary in the window: take its last keyframe, then look
+      // at this one again from the new start
+      double cut = last_ok >= 0 ? cuts[last_ok].time : t;
+      r = append_chunk(out, chunk_index++, start, cut);
+      if (r != SC_OK)
+        break;
+      start = cut;
+      last_ok = -1;
+      last_key = -1;
+      if (cut < t)
+        k--;
+      continue;
+    }
+
+    last_ok = k;
+    last_key = k;
+    if (cdc_boundary(hashes[k], span, target, bits))
+    {
+      r = append_chunk(out, chunk_index++, start, t);
+      if (r != SC_OK)
+        break;
+      start = t;
+      last_ok = -1;
+      last_key = -1;
+    }
   }
 
+  // The tail is bounded like any other chunk: with no keyframe past the
+  // window left, cut at the window's last one (or the last at all)
+  int tail_cut = last_ok >= 0 ? last_ok : last_key;
+  if (r == SC_OK && m->duration - start > max_dur + EPS && tail_cut >= 0)
+  {
+    r = append_chunk(out, chunk_index++, start, cuts[tail_cut].time);
+    start = cuts[tail_cut].time;
+  }
+
+  if (r == SC_OK && start < m->duration - EPS)
+    r = append_chunk(out, chunk_index++, start, m->duration);
+
+  free(hashes);
+  free(cuts);
+  return r;
+}
+
+/* ------------------------------------------------------------------ */
+/* Public chunk planner                                               */
+/* ------------------------------------------------------------------ */
+// Keyframe within tol of a multiple of grid
+static int on_grid(double t, double grid, double tol)
+{
+  return fabs(t - grid * round(t / grid)) <= tol + EPS;
+}
+
+// Packagers count segments from the output's first pts: the first
+// keyframe (about 1.4 s into a TS; the clip start for ranged probes).
+// On the planner's clock, i.e. before time_offset.
+static double grid_origin(const sc_probe_result *m)
+{
+  for (int64_t i = 0; m && i < m->count; i++)
+    if (m->frames[i].is_keyframe)
+      return m->frames[i].pts_time;
+  return 0.0;
+}
+
+double sc_grid_tolerance(sc_plan_config cfg)
+{
+  return cfg.grid_tol > 0.0 ? cfg.grid_tol : SC_GRID_DEFAULT_TOL;
+}
+
+int sc_plan_grid_misses(const sc_chunk_plan *plan, const sc_probe_result *meta,
+                        sc_plan_config cfg)
+{
+  if (!plan || cfg.grid_dur <= 0.0)
+    return 0;
+  // Plans are on the source clock, the origin on the planner's
+  double origin = meta ? grid_origin(meta) + meta->time_offset : 0.0;
+  int misses = 0;
+  for (int i = 1; i < plan->count; i++)
+    misses += !on_grid(plan->chunks[i].start - origin, cfg.grid_dur, sc_grid_tolerance(cfg));
+  return misses;
+}
+
+// The grid subset of the candidates, in place order; NULL when the grid
+// is off. A window with no grid candidate in reach falls back to the
+// full list.
+static int grid_cut_points(const cut_point *cuts, int64_t count, double origin,
+                           sc_plan_config cfg, cut_point **out, int64_t *out_count)
+{
+  *out = NULL;
+  *out_count = 0;
+  if (cfg.grid_dur <= 0.0)
+    return SC_OK;
+
+  cut_point *grid = malloc(sizeof(cut_point) * (count > 0 ? count : 1));
+  if (!grid)
+    return SC_ERR_NOMEM;
+  for (int64_t i = 0; i < count; i++)
+    if (on_grid(cuts[i].time - origin, cfg.grid_dur, sc_grid_tolerance(cfg)))
+      grid[(*out_count)++] = cuts[i];
+  *out = grid;
+  return SC_OK;
+}
+
+static int grid_key_times(const double *times, int64_t count, double origin,
+                          sc_plan_config cfg, double **out, int64_t *out_count)
+{
+  *out = NULL;
+  *out_count = 0;
+  if (cfg.grid_dur <= 0.0)
+    return SC_OK;
+
+  double *grid = malloc(sizeof(double) * (count > 0 ? count : 1));
+  if (!grid)
+    return SC_ERR_NOMEM;
+  for (int64_t i = 0; i < count; i++)
+    if (on_grid(times[i] - origin, cfg.grid_dur, sc_grid_tolerance(cfg)))
+      grid[(*out_count)++] = times[i];
+  *out = grid;
+  return SC_OK;
+}
+
+// Cut search over the GOP table; m is only needed for the duration and
+// the per-frame content hash
+static int plan_over_gops(const sc_probe_result *m,
+                          const sc_gop_table *gt,
+                          const byte_target *bt,
+                          sc_plan_config cfg,
+                          sc_chunk_plan *out)
+{
   double target = cfg.target_dur;
   if (cfg.ideal_parallel > 0)
-    target = m.duration / cfg.ideal_parallel;
+    target = m->duration / cfg.ideal_parallel;
+
+  // Size only: the duration a chunk of target_bytes has at the average
+  // bitrate sets the min/max window the size target is searched in
+  int64_t total_bytes = bt->prefix[gt->count];
+  if (bt->target_bytes > 0 && bt->weight >= 1.0 && cfg.ideal_parallel <= 0 && total_bytes > 0)
+    target = m->duration * (double)bt->target_bytes / (double)total_bytes;
   if (target <= 0.0)
     target = 10.0;
 
@@ -589,85 +1500,137 @@ int sc_plan_chunks(const sc_probe_result *meta,
   // Use smart cut points if enabled, otherwise fall back to simple keyframes
   int use_smart = cfg.enable_scene_detection || cfg.enable_complexity_adapt;
 
-  if (use_smart)
+  if (cfg.enable_content_defined)
+  {
+    int r = plan_content_defined(m, gt, target, min_dur, max_dur, out);
+    if (r != SC_OK)
+    {
+      sc_free_chunk_plan(out);
+      return r;
+    }
+  }
+  else if (use_smart)
   {
     // Smart chunking path
     cut_point *cuts = NULL;
-    int cut_count = 0;
-    int r = collect_cut_points(&m, &cuts, &cut_count, cfg.enable_scene_detection);
+    int64_t cut_count = 0;
+    int r = collect_cut_points(gt, &cuts, &cut_count, cfg.enable_scene_detection,
+                               cfg.enable_gop_analysis);
     if (r != SC_OK)
       return r;
 
     if (cut_count == 0)
     {
       free(cuts);
-      r = append_chunk(out, 0, 0.0, m.duration);
+      r = append_chunk(out, 0, 0.0, m->duration);
       if (r == SC_OK)
-        compute_chunk_stats(&out->chunks[0], &m, 0.0, m.duration);
+        compute_chunk_stats(&out->chunks[0], gt, 0.0, m->duration);
+      return r;
+    }
+
+    cut_point *grid_cuts = NULL;
+    int64_t grid_count = 0;
+    if ((r = grid_cut_points(cuts, cut_count, grid_origin(m), cfg, &grid_cuts,
+                              &grid_count)) != SC_OK)
+    {
+      free(cuts);
       return r;
     }
 
     double start = 0.0;
-    int cursor = 0;
+    int64_t cursor = 0;
+    int64_t grid_cursor = 0;
     int chunk_index = 0;
     double complexity_weight = cfg.complexity_weight > 0.0 ? cfg.complexity_weight : 0.3;
 
-    while (start < m.duration - EPS)
+    while (start < m->duration - EPS)
     {
-      double cut = choose_smart_cut(start, m.duration,
-                                     target, min_dur, max_dur,
-                                     cuts, cut_count, &cursor,
-                                     complexity_weight);
+      double cut = -1.0;
+      int64_t grid_mark = grid_cursor;
+      if (grid_cuts)
+        cut = choose_smart_cut(start, m->duration,
+                               target, min_dur, max_dur,
+                               grid_cuts, grid_count, &grid_cursor,
+                               complexity_weight, bt);
+      if (grid_cuts && cut - start > max_dur + EPS)
+        grid_cursor = grid_mark; // still in reach of the next window
+      if (cut < 0.0 || cut - start > max_dur + EPS)
+        cut = choose_smart_cut(start, m->duration,
+                               target, min_dur, max_dur,
+                               cuts, cut_count, &cursor,
+                               complexity_weight, bt);
       if (cut <= start + EPS)
-        cut = fmin(start + max_dur, m.duration);
+        cut = fmin(start + max_dur, m->duration);
 
       r = append_chunk(out, chunk_index++, start, cut);
       if (r != SC_OK)
       {
         free(cuts);
+        free(grid_cuts);
         sc_free_chunk_plan(out);
         return r;
       }
 
       // Compute statistics for this chunk
-      compute_chunk_stats(&out->chunks[out->count - 1], &m, start, cut);
+      compute_chunk_stats(&out->chunks[out->count - 1], gt, start, cut);
 
       start = cut;
     }
 
     free(cuts);
+    free(grid_cuts);
   }
   else
   {
     // Legacy simple chunking path
     double *key_times = NULL;
-    int key_count = 0;
-    int r = collect_keyframes(&m, &key_times, &key_count);
+    int64_t key_count = 0;
+    int r = collect_keyframes(gt, &key_times, &key_count);
     if (r != SC_OK)
       return r;
 
     if (key_count == 0)
     {
       free(key_times);
-      return append_chunk(out, 0, 0.0, m.duration);
+      return append_chunk(out, 0, 0.0, m->duration);
+    }
+
+    double *grid_times = NULL;
+    int64_t grid_count = 0;
+    if ((r = grid_key_times(key_times, key_count, grid_origin(m), cfg, &grid_times,
+                             &grid_count)) != SC_OK)
+    {
+      free(key_times);
+      return r;
     }
 
     double start = 0.0;
-    int cursor = 0;
+    int64_t cursor = 0;
+    int64_t grid_cursor = 0;
     int chunk_index = 0;
 
-    while (start < m.duration - EPS)
+    while (start < m->duration - EPS)
     {
-      double cut = choose_cut(start, m.duration,
-                              target, min_dur, max_dur,
-                              key_times, key_count, &cursor);
+      double cut = -1.0;
+      int64_t grid_mark = grid_cursor;
+      if (grid_times)
+        cut = choose_cut(start, m->duration,
+                         target, min_dur, max_dur,
+                         grid_times, grid_count, &grid_cursor, bt);
+      if (grid_times && cut - start > max_dur + EPS)
+        grid_cursor = grid_mark; // still in reach of the next window
+      if (cut < 0.0 || cut - start > max_dur + EPS)
+        cut = choose_cut(start, m->duration,
+                         target, min_dur, max_dur,
+                         key_times, key_count, &cursor, bt);
       if (cut <= start + EPS)
-        cut = fmin(start + max_dur, m.duration);
+        cut = fmin(start + max_dur, m->duration);
 
       r = append_chunk(out, chunk_index++, start, cut);
       if (r != SC_OK)
       {
         free(key_times);
+        free(grid_times);
         sc_free_chunk_plan(out);
         return r;
       }
@@ -675,6 +1638,7 @@ int sc_plan_chunks(const sc_probe_result *meta,
     }
 
     free(key_times);
+    free(grid_times);
   }
 
   if (out->count == 0)
@@ -683,10 +1647,10 @@ int sc_plan_chunks(const sc_probe_result *meta,
     return SC_ERR_INVAL;
   }
 
-  out->chunks[out->count - 1].end = m.duration;
+  out->chunks[out->count - 1].end = m->duration;
 
   if (cfg.avoid_tiny_last)
-    merge_tiny_tail(out, min_dur, m.duration);
+    merge_tiny_tail(out, min_dur, m->duration);
 
   // Normalize chunk boundaries
   double total = 0.0;
@@ -703,9 +1667,9 @@ int sc_plan_chunks(const sc_probe_result *meta,
     total += c->end - c->start;
   }
 
-  double diff = fabs(total - m.duration);
+  double diff = fabs(total - m->duration);
   if (diff > 0.001)
-    out->chunks[out->count - 1].end += (m.duration - total);
+    out->chunks[out->count - 1].end += (m->duration - total);
 
   renumber_chunks(out);
 
@@ -714,7 +1678,7 @@ int sc_plan_chunks(const sc_probe_result *meta,
   {
     for (int i = 0; i < out->count; i++)
     {
-      compute_chunk_stats(&out->chunks[i], &m,
+      compute_chunk_stats(&out->chunks[i], gt,
                           out->chunks[i].start,
                           out->chunks[i].end);
     }
@@ -723,10 +1687,1356 @@ int sc_plan_chunks(const sc_probe_result *meta,
   return SC_OK;
 }
 
-void sc_free_chunk_plan(sc_chunk_plan *plan)
+/* ------------------------------------------------------------------ */
+/* Hierarchical (node -> worker) planning                             */
+/* ------------------------------------------------------------------ */
+// Keyframe boundaries of the whole source with the work before each:
+// at[0] = 0 and at[count - 1] = duration bracket the cut candidates
+typedef struct
 {
-  if (!plan)
-    return;
-  free(plan->chunks);
-  memset(plan, 0, sizeof(*plan));
+  double *at;
+  double *work;
+  int64_t count;
+} work_bounds;
+
+// Encode work of a GOP: its frames, weighted up by complexity when the
+// planner adapts to it
+static double gop_work(const sc_gop *g, sc_plan_config cfg)
+{
+  double w = (double)g->frame_count;
+  if (cfg.enable_complexity_adapt)
+  {
+    double weight = cfg.complexity_weight > 0.0 ? cfg.complexity_weight : 0.3;
+    w *= 1.0 + weight * g->cost;
+  }
+  return w;
+}
+
+static int work_bounds_init(work_bounds *wb, const sc_gop_table *gt,
+                            double duration, sc_plan_config cfg)
+{
+  memset(wb, 0, sizeof(*wb));
+  wb->at = malloc(sizeof(double) * ((size_t)gt->count + 2));
+  wb->work = malloc(sizeof(double) * ((size_t)gt->count + 2));
+  if (!wb->at || !wb->work)
+  {
+    free(wb->at);
+    free(wb->work);
+    return SC_ERR_NOMEM;
+  }
+
+  double work = 0.0;
+  wb->at[0] = 0.0;
+  wb->work[0] = 0.0;
+  wb->count = 1;
+  for (int64_t i = 0; i < gt->count; i++)
+  {
+    const sc_gop *g = &gt->gops[i];
+    if (g->is_keyframe && g->start > wb->at[wb->count - 1] + EPS &&
+        g->start < duration - EPS)
+    {
+      wb->at[wb->count] = g->start;
+      wb->work[wb->count] = work;
+      wb->count++;
+    }
+    work += gop_work(g, cfg);
+  }
+  wb->at[wb->count] = duration;
+  wb->work[wb->count] = work;
+  wb->count++;
+  return SC_OK;
+}
+
+// Split boundaries [lo, hi] into up to parts pieces of equal work. Each
+// cut is the boundary whose work is nearest its share; pieces never come
+// out empty, so a span with few keyframes just gets fewer of them.
+// Cuts go to cuts[], sorted; returns how many.
+static int balanced_cuts(const work_bounds *wb, int64_t lo, int64_t hi, int parts,
+                         int64_t *cuts)
+{
+  int count = 0;
+  int64_t prev = lo;
+  double span = wb->work[hi] - wb->work[lo];
+
+  for (int k = 1; k < parts && prev + 1 < hi; k++)
+  {
+    double want = wb->work[lo] + span * k / parts;
+
+    // First boundary after prev with at least the wanted work
+    int64_t a = prev + 1, b = hi;
+    while (a < b)
+    {
+      int64_t mid = a + (b - a) / 2;
+      if (wb->work[mid] < want)
+        a = mid + 1;
+      else
+        b = mid;
+    }
+    if (a > prev + 1 && want - wb->work[a - 1] <= wb->work[a] - want)
+      a--;
+    if (a >= hi)
+      break;
+
+    cuts[count++] = a;
+    prev = a;
+  }
+  return count;
+}
+
+// Worker chunks per node: enough for every local worker, and more (in
+// multiples of workers) when the node's span is long next to the
+// target, so cores finish together
+static int micro_parts(double span, int workers, sc_plan_config cfg)
+{
+  if (cfg.ideal_parallel > 0 || cfg.target_dur <= 0.0)
+    return workers;
+  double rounds = ceil(span / (cfg.target_dur * workers) - EPS);
+  return rounds > 1.0 ? (int)rounds * workers : workers;
+}
+
+static int plan_hierarchical(const sc_probe_result *m,
+                             const sc_gop_table *gt,
+                             sc_plan_config cfg,
+                             sc_chunk_plan *out)
+{
+  int workers = cfg.node_workers > 0 ? cfg.node_workers : 1;
+
+  work_bounds wb;
+  int r = work_bounds_init(&wb, gt, m->duration, cfg);
+  if (r != SC_OK)
+    return r;
+
+  // Room for every boundary as a cut at either level
+  int64_t *macro = malloc(sizeof(int64_t) * ((size_t)wb.count + 1));
+  int64_t *micro = malloc(sizeof(int64_t) * ((size_t)wb.count + 1));
+  if (!macro || !micro)
+  {
+    r = SC_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  // Macro level: one span of balanced work per node
+  int nodes = balanced_cuts(&wb, 0, wb.count - 1, cfg.nodes, macro + 1) + 1;
+  macro[0] = 0;
+  macro[nodes] = wb.count - 1;
+
+  // Micro level: each node's span cut again for its workers
+  int index = 0;
+  for (int n = 0; n < nodes && r == SC_OK; n++)
+  {
+    int64_t lo = macro[n], hi = macro[n + 1];
+    int parts = micro_parts(wb.at[hi] - wb.at[lo], workers, cfg);
+    int cuts = balanced_cuts(&wb, lo, hi, parts, micro + 1);
+    micro[0] = lo;
+    micro[cuts + 1] = hi;
+
+    for (int c = 0; c <= cuts && r == SC_OK; c++)
+    {
+      double start = wb.at[micro[c]], end = wb.at[micro[c + 1]];
+      r = append_chunk(out, index++, start, end);
+      if (r == SC_OK)
+      {
+        out->chunks[out->count - 1].node = n;
+        compute_chunk_stats(&out->chunks[out->count - 1], gt, start, end);
+      }
+    }
+  }
+
+  if (r == SC_OK && out->count == 0)
+    r = SC_ERR_INVAL;
+
+cleanup:
+  free(macro);
+  free(micro);
+  free(wb.at);
+  free(wb.work);
+  if (r != SC_OK)
+    sc_free_chunk_plan(out);
+  return r;
+}
+
+int sc_plan_chunks(const sc_probe_result *meta,
+                   sc_plan_config cfg,
+                   sc_chunk_plan *out)
+{
+  if (!meta || !out || meta->count == 0 || meta->duration <= 0.0)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+
+  // Make a mutable copy of probe data for analysis
+  sc_probe_result m = *meta;
+
+  // Run smart analysis if enabled
+  if (cfg.enable_complexity_adapt || cfg.enable_scene_detection)
+  {
+    compute_complexity(&m);
+  }
+
+  if (cfg.enable_scene_detection)
+  {
+    detect_scene_changes(&m, cfg.scene_threshold);
+  }
+
+  // Every decision below is made per GOP, not per frame
+  sc_gop_table gt;
+  int r = sc_build_gop_table(&m, &gt);
+  if (r != SC_OK)
+    return r;
+
+  byte_target bt;
+  r = byte_target_init(&bt, &gt, cfg);
+  if (r == SC_OK)
+  {
+    if (cfg.nodes > 0)
+      r = plan_hierarchical(&m, &gt, cfg, out);
+    else
+      r = plan_over_gops(&m, &gt, &bt, cfg, out);
+  }
+
+  // Per-chunk sizes for storage/upload layers, whatever the objective
+  if (r == SC_OK)
+  {
+    for (int i = 0; i < out->count; i++)
+      out->chunks[i].bytes = bytes_before(&bt, out->chunks[i].end) -
+                             bytes_before(&bt, out->chunks[i].start);
+  }
+  free(bt.prefix);
+  sc_free_gop_table(&gt);
+
+  // Ranged probes are planned from zero; put the plan back on the
+  // source timeline
+  if (r == SC_OK && meta->time_offset != 0.0)
+  {
+    for (int i = 0; i < out->count; i++)
+    {
+      out->chunks[i].start += meta->time_offset;
+      out->chunks[i].end += meta->time_offset;
+    }
+  }
+  return r;
+}
+
+void sc_free_chunk_plan(sc_chunk_plan *plan)
+{
+  if (!plan)
+    return;
+  free(plan->chunks);
+  memset(plan, 0, sizeof(*plan));
+}
+
+int sc_plan_nodes(const sc_chunk_plan *plan, sc_chunk_plan *out)
+{
+  if (!plan || !out || plan->count == 0)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+  for (int i = 0; i < plan->count; i++)
+  {
+    const sc_chunk *c = &plan->chunks[i];
+    if (out->count == 0 || out->chunks[out->count - 1].index != c->node)
+    {
+      if (ensure_chunk_capacity(out, out->count + 1) != SC_OK)
+      {
+        sc_free_chunk_plan(out);
+        return SC_ERR_NOMEM;
+      }
+      out->chunks[out->count++] = (sc_chunk){
+          .index = c->node,
+          .start = c->start,
+          .end = c->start,
+          .node = c->node};
+    }
+
+    // Sums, and complexity weighted by duration
+    sc_chunk *n = &out->chunks[out->count - 1];
+    double before = n->end - n->start;
+    double dur = c->end - c->start;
+    n->end = c->end;
+    if (before + dur > 0.0)
+      n->avg_complexity = (n->avg_complexity * before + c->avg_complexity * dur) /
+                          (before + dur);
+    n->keyframe_count += c->keyframe_count;
+    n->scene_cut_count += c->scene_cut_count;
+    n->bytes += c->bytes;
+  }
+  return SC_OK;
+}
+
+// FNV-1a over the chunk count and millisecond-rounded boundaries
+static uint64_t fnv1a_u64(uint64_t h, uint64_t v)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    h ^= (v >> (i * 8)) & 0xff;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t sc_plan_hash(const sc_chunk_plan *plan)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  if (!plan)
+    return h;
+
+  h = fnv1a_u64(h, (uint64_t)plan->count);
+  for (int i = 0; i < plan->count; i++)
+  {
+    h = fnv1a_u64(h, (uint64_t)llround(plan->chunks[i].start * 1000.0));
+    h = fnv1a_u64(h, (uint64_t)llround(plan->chunks[i].end * 1000.0));
+  }
+  return h;
+}
+
+/* ------------------------------------------------------------------ */
+/* Multi-rendition aligned planning                                   */
+/* ------------------------------------------------------------------ */
+
+// Sorted keyframe times of one probe
+static int keyframe_times(const sc_probe_result *m, double **out, int64_t *count)
+{
+  *out = NULL;
+  *count = 0;
+  int64_t n = 0;
+  for (int64_t i = 0; i < m->count; i++)
+    n += m->frames[i].is_keyframe ? 1 : 0;
+  if (n == 0)
+    return SC_OK;
+
+  double *t = malloc((size_t)n * sizeof(*t));
+  if (!t)
+    return SC_ERR_NOMEM;
+  n = 0;
+  for (int64_t i = 0; i < m->count; i++)
+    if (m->frames[i].is_keyframe)
+      t[n++] = m->frames[i].pts_time;
+  qsort(t, (size_t)n, sizeof(*t), cmp_double);
+
+  *out = t;
+  *count = n;
+  return SC_OK;
+}
+
+// Keyframe of a sorted list nearest to t, or -1 when none is within tol
+static int64_t nearest_keyframe(const double *t, int64_t n, double at, double tol)
+{
+  int64_t lo = 0, hi = n;
+  while (lo < hi)
+  {
+    int64_t mid = lo + (hi - lo) / 2;
+    if (t[mid] < at)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  int64_t best = -1;
+  double best_d = tol + EPS;
+  for (int64_t k = lo - 1; k <= lo; k++)
+  {
+    if (k < 0 || k >= n)
+      continue;
+    double d = fabs(t[k] - at);
+    if (d <= best_d)
+    {
+      best = k;
+      best_d = d;
+    }
+  }
+  return best;
+}
+
+static int push_align_move(sc_align_report *r, int input, double wanted, double actual)
+{
+  if (r->count + 1 > r->capacity)
+  {
+    int newcap = r->capacity ? r->capacity * 2 : 16;
+    sc_align_move *moves = realloc(r->moves, (size_t)newcap * sizeof(*moves));
+    if (!moves)
+      return SC_ERR_NOMEM;
+    r->moves = moves;
+    r->capacity = newcap;
+  }
+  r->moves[r->count++] = (sc_align_move){input, wanted, actual};
+  return SC_OK;
+}
+
+// Aligned time of a reference keyframe, or -1 when it is not shared
+static double shared_cut(double **keys, const int64_t *key_count, int n,
+                         double t, double tol, int *missing_input)
+{
+  double cut = t;
+  for (int j = 1; j < n; j++)
+  {
+    int64_t k = nearest_keyframe(keys[j], key_count[j], t, tol);
+    if (k < 0)
+    {
+      if (missing_input)
+        *missing_input = j;
+      return -1.0;
+    }
+    // The splitter starts a chunk on the first keyframe at or after its
+    // start, so the earliest of the matched keyframes works for all
+    cut = fmin(cut, keys[j][k]);
+  }
+  return cut;
+}
+
+// Bytes and stats of a plan whose boundaries moved after planning,
+// from m's GOP table; stats only where the planner fills them in
+static int refresh_chunk_stats(const sc_probe_result *m, sc_plan_config cfg,
+                               sc_chunk_plan *plan)
+{
+  sc_gop_table gt;
+  int r = sc_build_gop_table(m, &gt);
+  if (r != SC_OK)
+    return r;
+
+  byte_target bt;
+  r = byte_target_init(&bt, &gt, cfg);
+  if (r == SC_OK)
+  {
+    const int stats = cfg.enable_scene_detection || cfg.enable_complexity_adapt || cfg.nodes > 0;
+    for (int i = 0; i < plan->count; i++)
+    {
+      sc_chunk *c = &plan->chunks[i];
+      double start = c->start - m->time_offset;
+      double end = c->end - m->time_offset;
+      c->bytes = bytes_before(&bt, end) - bytes_before(&bt, start);
+      if (stats)
+        compute_chunk_stats(c, &gt, start, end);
+    }
+  }
+  free(bt.prefix);
+  sc_free_gop_table(&gt);
+  return r;
+}
+
+int sc_plan_chunks_aligned(const sc_probe_result *probes, int n,
+                           sc_plan_config cfg, double tolerance,
+                           sc_chunk_plan *out, sc_align_report *report)
+{
+  if (!probes || n <= 0 || !out)
+    return SC_ERR_INVAL;
+  if (report)
+    memset(report, 0, sizeof(*report));
+  if (cfg.enable_content_defined)
+    return SC_ERR_INVAL;
+
+  const sc_probe_result *ref = &probes[0];
+  if (ref->count == 0 || ref->duration <= 0.0)
+    return SC_ERR_INVAL;
+  if (tolerance < 0.0)
+    tolerance = 0.0;
+
+  int r = SC_OK;
+  double **keys = calloc((size_t)n, sizeof(*keys));
+  int64_t *key_count = calloc((size_t)n, sizeof(*key_count));
+  sc_probe_result masked;
+  memset(&masked, 0, sizeof(masked));
+  sc_chunk_plan solo;
+  memset(&solo, 0, sizeof(solo));
+  memset(out, 0, sizeof(*out));
+
+  if (!keys || !key_count)
+  {
+    r = SC_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  double duration = 0.0;
+  for (int j = 0; j < n; j++)
+  {
+    if ((r = keyframe_times(&probes[j], &keys[j], &key_count[j])) != SC_OK)
+      goto cleanup;
+    duration = fmax(duration, probes[j].duration);
+  }
+
+  // Reference frames with only the shared keyframes left as cut points
+  masked = *ref;
+  masked.frames = malloc((size_t)ref->count * sizeof(*masked.frames));
+  if (!masked.frames)
+  {
+    r = SC_ERR_NOMEM;
+    goto cleanup;
+  }
+  memcpy(masked.frames, ref->frames, (size_t)ref->count * sizeof(*masked.frames));
+  masked.capacity = ref->count;
+
+  int64_t shared = 0;
+  for (int64_t i = 0; i < masked.count; i++)
+  {
+    sc_frame_meta *fm = &masked.frames[i];
+    if (!fm->is_keyframe)
+      continue;
+    if (shared_cut(keys, key_count, n, fm->pts_time, tolerance, NULL) < 0.0)
+      fm->is_keyframe = 0;
+    else
+      shared++;
+  }
+  if (report)
+    report->common_keyframes = (int)(shared < INT32_MAX ? shared : INT32_MAX);
+
+  if ((r = sc_plan_chunks(&masked, cfg, out)) != SC_OK)
+    goto cleanup;
+
+  // Move each cut onto the earliest matching keyframe across inputs
+  for (int i = 1; i < out->count; i++)
+  {
+    double cut = shared_cut(keys, key_count, n, out->chunks[i].start, tolerance, NULL);
+    if (cut >= 0.0)
+    {
+      out->chunks[i - 1].end = cut;
+      out->chunks[i].start = cut;
+    }
+  }
+  out->chunks[out->count - 1].end = duration;
+
+  // masked still holds the planner's complexity and scene flags
+  if ((r = refresh_chunk_stats(&masked, cfg, out)) != SC_OK)
+    goto cleanup;
+
+  // Which inputs pulled the reference's own cuts elsewhere
+  if (report && n > 1)
+  {
+    sc_probe_result solo_probe = masked;
+    memcpy(solo_probe.frames, ref->frames, (size_t)ref->count * sizeof(*solo_probe.frames));
+    if ((r = sc_plan_chunks(&solo_probe, cfg, &solo)) != SC_OK)
+      goto cleanup;
+
+    for (int i = 1; i < solo.count; i++)
+    {
+      double wanted = solo.chunks[i].start;
+      int missing = -1;
+      if (shared_cut(keys, key_count, n, wanted, tolerance, &missing) >= 0.0)
+        continue;
+
+      double actual = out->count > 1 ? out->chunks[1].start : duration;
+      for (int c = 1; c < out->count; c++)
+        if (fabs(out->chunks[c].start - wanted) < fabs(actual - wanted))
+          actual = out->chunks[c].start;
+
+      for (int j = 1; j < n; j++)
+      {
+        if (nearest_keyframe(keys[j], key_count[j], wanted, tolerance) >= 0)
+          continue;
+        if ((r = push_align_move(report, j, wanted, actual)) != SC_OK)
+          goto cleanup;
+      }
+    }
+  }
+
+cleanup:
+  if (keys)
+    for (int j = 0; j < n; j++)
+      free(keys[j]);
+  free(keys);
+  free(key_count);
+  free(masked.frames);
+  sc_free_chunk_plan(&solo);
+  if (r != SC_OK)
+  {
+    sc_free_chunk_plan(out);
+    if (report)
+      sc_free_align_report(report);
+  }
+  return r;
+}
+
+typedef struct
+{
+  const char *filename;
+  int flags;
+  sc_probe_result *out;
+  int rc;
+} probe_job;
+
+static void *probe_worker(void *arg)
+{
+  probe_job *job = arg;
+  job->rc = sc_probe_video_ex(job->filename, job->flags, job->out);
+  return NULL;
+}
+
+int sc_plan_chunks_multi(const char *const *filenames, int n, int probe_flags,
+                         sc_plan_config cfg, double tolerance,
+                         sc_chunk_plan *out, sc_align_report *report)
+{
+  if (!filenames || n <= 0 || !out)
+    return SC_ERR_INVAL;
+
+  sc_probe_result *probes = calloc((size_t)n, sizeof(*probes));
+  probe_job *jobs = calloc((size_t)n, sizeof(*jobs));
+  pthread_t *threads = calloc((size_t)n, sizeof(*threads));
+  int *started = calloc((size_t)n, sizeof(*started));
+  if (!probes || !jobs || !threads || !started)
+  {
+    free(probes);
+    free(jobs);
+    free(threads);
+    free(started);
+    return SC_ERR_NOMEM;
+  }
+
+  // One probe per rendition, all at once; a failed thread start just
+  // probes inline
+  for (int j = 0; j < n; j++)
+  {
+    jobs[j] = (probe_job){filenames[j], probe_flags, &probes[j], SC_OK};
+    started[j] = pthread_create(&threads[j], NULL, probe_worker, &jobs[j]) == 0;
+    if (!started[j])
+      probe_worker(&jobs[j]);
+  }
+
+  int r = SC_OK;
+  for (int j = 0; j < n; j++)
+  {
+    if (started[j])
+      pthread_join(threads[j], NULL);
+    if (jobs[j].rc != SC_OK && r == SC_OK)
+      r = jobs[j].rc;
+  }
+
+  if (r == SC_OK)
+    r = sc_plan_chunks_aligned(probes, n, cfg, tolerance, out, report);
+
+  for (int j = 0; j < n; j++)
+    sc_free_probe(&probes[j]);
+  free(probes);
+  free(jobs);
+  free(threads);
+  free(started);
+  return r;
+}
+
+void sc_free_align_report(sc_align_report *r)
+{
+  if (!r)
+    return;
+  free(r->moves);
+  memset(r, 0, sizeof(*r));
+}
+
+/* ------------------------------------------------------------------ */
+/* Edit decision lists                                                */
+/* ------------------------------------------------------------------ */
+static int cmp_range(const void *a, const void *b)
+{
+  const sc_range *x = a;
+  const sc_range *y = b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+// Keyframes from a backward seek to start up to the first one at or
+// after end. Demuxers that seek by bitrate (MPEG-TS) can land past
+// start; the seek is then retried further back until the first
+// keyframe read is at or before it.
+static int probe_range_keys(AVFormatContext *fmt, int vstream, int audio, double start,
+                            double end, AVPacket *pkt, sc_probe_result *out)
+{
+  AVRational tb = fmt->streams[vstream]->time_base;
+  double last = out->count > 0 ? out->frames[out->count - 1].pts_time : -INFINITY;
+
+  // Ranges come sorted: an earlier one already read up to here
+  if (end <= last + EPS)
+    return SC_OK;
+
+  double back = 0.0;
+  for (;;)
+  {
+    double target = fmax(start - back, 0.0);
+    if (av_seek_frame(fmt, vstream, (int64_t)(target / av_q2d(tb)), AVSEEK_FLAG_BACKWARD) < 0)
+      return SC_ERR_FFMPEG;
+
+    int anchored = 0;
+    int overshot = 0;
+    while (av_read_frame(fmt, pkt) >= 0)
+    {
+      int is_key = audio || (pkt->flags & AV_PKT_FLAG_KEY);
+      if (pkt->stream_index != vstream || !is_key)
+      {
+        av_packet_unref(pkt);
+        continue;
+      }
+
+      double pts = packet_time(pkt, tb, last);
+      int size = pkt->size;
+      av_packet_unref(pkt);
+
+      if (!anchored && pts > start + EPS && target > 0.0)
+      {
+        overshot = 1;
+        break;
+      }
+      anchored = 1;
+
+      if (pts > last + EPS)
+      {
+        if (ensure_frame_capacity(out, out->count + 1) != SC_OK)
+          return SC_ERR_NOMEM;
+        sc_frame_meta *fm = &out->frames[out->count++];
+        memset(fm, 0, sizeof(*fm));
+        fm->pts_time = pts;
+        fm->is_keyframe = 1;
+        fm->pkt_size = size;
+        fm->frame_span = 1;
+        fm->pict_type = audio ? PICT_TYPE_UNKNOWN : PICT_TYPE_I;
+        last = pts;
+      }
+      if (pts >= end - EPS)
+        break;
+    }
+
+    if (!overshot)
+      return SC_OK;
+    back = back > 0.0 ? back * 2.0 : 1.0;
+  }
+}
+
+int sc_probe_ranges(const char *filename, int flags, const sc_range *ranges, int n,
+                    sc_probe_result *out)
+{
+  if (!filename || !ranges || n <= 0 || !out)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+  out->keyframes_only = 1;
+
+  AVFormatContext *fmt = NULL;
+  if (avformat_open_input(&fmt, filename, NULL, NULL) < 0)
+    return SC_ERR_FFMPEG;
+  if (avformat_find_stream_info(fmt, NULL) < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_FFMPEG;
+  }
+
+  int vstream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  int audio = 0;
+  if (vstream < 0 && (flags & SC_PROBE_AUDIO))
+  {
+    vstream = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    audio = vstream >= 0;
+  }
+  if (vstream < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_NOSTREAM;
+  }
+
+  AVStream *st = fmt->streams[vstream];
+  out->audio_only = audio;
+  if (audio && st->codecpar->initial_padding > 0 && st->codecpar->sample_rate > 0)
+    out->audio_priming = st->codecpar->initial_padding / (double)st->codecpar->sample_rate;
+
+  sc_range *sorted = malloc((size_t)n * sizeof(*sorted));
+  AVPacket *pkt = av_packet_alloc();
+  int r = sorted && pkt ? SC_OK : SC_ERR_NOMEM;
+  if (r == SC_OK)
+  {
+    memcpy(sorted, ranges, (size_t)n * sizeof(*sorted));
+    qsort(sorted, (size_t)n, sizeof(*sorted), cmp_range);
+  }
+  for (int i = 0; i < n && r == SC_OK; i++)
+  {
+    if (sorted[i].end > sorted[i].start + EPS)
+      r = probe_range_keys(fmt, vstream, audio, fmax(sorted[i].start, 0.0), sorted[i].end, pkt,
+                           out);
+  }
+
+  // Nothing is read to the end: the length comes from the container,
+  // on the same (not rebased) clock as the packet times
+  double duration = 0.0;
+  if (st->duration > 0 && st->duration != AV_NOPTS_VALUE)
+    duration = (st->duration + (st->start_time != AV_NOPTS_VALUE ? st->start_time : 0)) *
+               av_q2d(st->time_base);
+  else if (fmt->duration > 0 && fmt->duration != AV_NOPTS_VALUE)
+    duration = (fmt->duration + (fmt->start_time != AV_NOPTS_VALUE ? fmt->start_time : 0)) /
+               (double)AV_TIME_BASE;
+  if (out->count > 0)
+    duration = fmax(duration, out->frames[out->count - 1].pts_time);
+  out->duration = duration;
+
+  av_packet_free(&pkt);
+  free(sorted);
+  avformat_close_input(&fmt);
+
+  if (r == SC_OK && out->duration <= 0.0)
+    r = SC_ERR_INVAL;
+  if (r != SC_OK)
+    sc_free_probe(out);
+  return r;
+}
+
+int sc_plan_ranges(const sc_probe_result *m, const sc_range *ranges, int n,
+                   sc_chunk_plan *out)
+{
+  if (!m || !ranges || n <= 0 || !out || m->duration <= 0.0)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+
+  double *keys = NULL;
+  int64_t key_count = 0;
+  int r = keyframe_times(m, &keys, &key_count);
+  if (r != SC_OK)
+    return r;
+
+  sc_range *sorted = malloc((size_t)n * sizeof(*sorted));
+  if (!sorted)
+  {
+    free(keys);
+    return SC_ERR_NOMEM;
+  }
+
+  // Clamp to the source, widen to keyframes
+  int count = 0;
+  for (int i = 0; i < n; i++)
+  {
+    double start = fmax(ranges[i].start, 0.0);
+    double end = fmin(ranges[i].end, m->duration);
+    if (end <= start + EPS)
+      continue;
+
+    int64_t lo = 0, hi = key_count;
+    while (lo < hi)
+    {
+      int64_t mid = lo + (hi - lo) / 2;
+      if (keys[mid] <= start + EPS)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    start = lo > 0 ? keys[lo - 1] : 0.0;
+
+    lo = 0;
+    hi = key_count;
+    while (lo < hi)
+    {
+      int64_t mid = lo + (hi - lo) / 2;
+      if (keys[mid] < end - EPS)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    end = lo < key_count ? keys[lo] : m->duration;
+
+    sorted[count++] = (sc_range){start, end};
+  }
+  qsort(sorted, (size_t)count, sizeof(*sorted), cmp_range);
+
+  // Ranges that now overlap or touch are read as one
+  int index = 0;
+  for (int i = 0; i < count && r == SC_OK; i++)
+  {
+    double start = sorted[i].start;
+    double end = sorted[i].end;
+    while (i + 1 < count && sorted[i + 1].start <= end + EPS)
+      end = fmax(end, sorted[++i].end);
+    r = append_chunk(out, index++, start, end);
+  }
+
+  free(sorted);
+  free(keys);
+  if (r == SC_OK && out->count == 0)
+    r = SC_ERR_INVAL;
+  if (r != SC_OK)
+    sc_free_chunk_plan(out);
+  return r;
+}
+
+/* ------------------------------------------------------------------ */
+/* Online planner                                                     */
+/* ------------------------------------------------------------------ */
+// Per-keyframe bookkeeping kept alongside the pending cut points
+typedef struct
+{
+  int64_t gop_bytes;   // bytes of this keyframe and the frames after it
+  int gop_frames;
+  int scene_eligible;  // enough frames before it for the scene window
+  double avg_before;
+  int64_t after_sum;
+  int after_n;         // frames seen from the keyframe on
+  int scene_ready;     // scene flag final
+} online_gop;
+
+struct sc_online_planner
+{
+  sc_plan_config cfg;
+  double duration_hint;
+  double target;
+  double min_dur;
+  double max_dur;
+  double complexity_weight;
+  int use_smart;
+  int use_scene;
+  double scene_threshold;
+
+  double start;       // start of the undecided chunk
+  int next_index;
+
+  cut_point *cuts;    // keyframes at or after start, in push order
+  online_gop *gops;
+  int cut_count;
+  int cut_capacity;
+
+  int64_t lead_bytes; // frames before the first keyframe
+  int lead_frames;
+
+  int64_t ring[SCENE_WINDOW];
+  int64_t frames_seen;
+  int64_t min_size;
+  int64_t max_size;
+
+  sc_chunk_plan ready; // decided chunks; [ready_pos, count) not yet taken
+  int ready_pos;
+  int finished;
+};
+
+int sc_online_create(sc_plan_config cfg, double duration_hint,
+                     sc_online_planner **out)
+{
+  if (!out)
+    return SC_ERR_INVAL;
+
+  // Content-defined boundaries are only implemented for whole probes
+  if (cfg.enable_content_defined)
+    return SC_ERR_INVAL;
+
+  sc_online_planner *p = calloc(1, sizeof(*p));
+  if (!p)
+    return SC_ERR_NOMEM;
+
+  p->cfg = cfg;
+  p->duration_hint = duration_hint > 0.0 ? duration_hint : 0.0;
+
+  p->target = cfg.target_dur;
+  if (cfg.ideal_parallel > 0 && p->duration_hint > 0.0)
+    p->target = p->duration_hint / cfg.ideal_parallel;
+  if (p->target <= 0.0)
+    p->target = 10.0;
+
+  p->min_dur = cfg.min_dur > 0.0 ? cfg.min_dur : p->target * 0.5;
+  p->max_dur = cfg.max_dur > 0.0 ? cfg.max_dur : p->target * 2.0;
+  if (p->max_dur < p->min_dur)
+    p->max_dur = p->min_dur;
+
+  p->use_smart = cfg.enable_scene_detection || cfg.enable_complexity_adapt;
+  p->use_scene = cfg.enable_scene_detection;
+  p->scene_threshold = cfg.scene_threshold > 0.0 ? cfg.scene_threshold
+                                                 : DEFAULT_SCENE_THRESHOLD;
+
+  // The legacy planner ranks by distance to target alone, which is what
+  // choose_smart_cut reduces to with no weighting and no scene flags
+  p->complexity_weight = 0.0;
+  if (p->use_smart)
+    p->complexity_weight = cfg.complexity_weight > 0.0 ? cfg.complexity_weight : 0.3;
+
+  *out = p;
+  return SC_OK;
+}
+
+static int online_add_cut(sc_online_planner *p, double t)
+{
+  if (p->cut_count == p->cut_capacity)
+  {
+    int newcap = p->cut_capacity ? p->cut_capacity * 2 : 64;
+    cut_point *cuts = realloc(p->cuts, newcap * sizeof(*cuts));
+    if (!cuts)
+      return SC_ERR_NOMEM;
+    p->cuts = cuts;
+
+    online_gop *gops = realloc(p->gops, newcap * sizeof(*gops));
+    if (!gops)
+      return SC_ERR_NOMEM;
+    p->gops = gops;
+    p->cut_capacity = newcap;
+  }
+
+  p->cuts[p->cut_count] = (cut_point){
+      .time = t,
+      .is_keyframe = 1,
+      .is_scene_cut = 0,
+      .complexity = 0.0,
+      .quality_score = 100};
+
+  online_gop *g = &p->gops[p->cut_count];
+  memset(g, 0, sizeof(*g));
+  g->scene_eligible = p->use_scene && p->frames_seen >= SCENE_WINDOW;
+  g->scene_ready = !g->scene_eligible;
+  if (g->scene_eligible)
+  {
+    for (int j = 0; j < SCENE_WINDOW; j++)
+      g->avg_before += p->ring[j];
+    g->avg_before /= SCENE_WINDOW;
+  }
+
+  p->cut_count++;
+  return SC_OK;
+}
+
+// Feed one frame to the scene windows still open; a keyframe's window
+// starts with the keyframe itself. A flag becomes final one frame after
+// its window fills, matching the batch detector which ignores keyframes
+// in the last SCENE_WINDOW frames of the stream.
+static void online_scene_update(sc_online_planner *p, int64_t size)
+{
+  for (int i = p->cut_count - 1; i >= 0; i--)
+  {
+    online_gop *g = &p->gops[i];
+    if (g->scene_ready)
+      break;
+
+    if (g->after_n == SCENE_WINDOW)
+    {
+      double avg_after = (double)g->after_sum / SCENE_WINDOW;
+      double ratio = 0.0;
+      if (g->avg_before > 0.0)
+        ratio = fabs(avg_after - g->avg_before) / g->avg_before;
+      if (ratio > p->scene_threshold)
+      {
+        p->cuts[i].is_scene_cut = 1;
+        p->cuts[i].quality_score += 50;
+      }
+      g->scene_ready = 1;
+      continue;
+    }
+
+    g->after_sum += size;
+    g->after_n++;
+  }
+}
+
+static double online_complexity(const sc_online_planner *p,
+                                 int64_t bytes, int frames)
+{
+  if (frames <= 0)
+    return 0.0;
+  double range = (double)(p->max_size - p->min_size);
+  if (range < 1.0)
+    range = 1.0;
+  return ((double)bytes / frames - (double)p->min_size) / range;
+}
+
+// Record [start, cut) as decided and drop the cut points it consumed
+static int online_emit(sc_online_planner *p, double cut)
+{
+  if (cut < p->start + EPS)
+    return SC_OK;
+
+  if (ensure_chunk_capacity(&p->ready, p->ready.count + 1) != SC_OK)
+    return SC_ERR_NOMEM;
+
+  sc_chunk c = {
+      .index = p->next_index++,
+      .start = p->start,
+      .end = cut};
+
+  int64_t bytes = 0;
+  int frames = 0;
+  if (c.index == 0)
+  {
+    bytes += p->lead_bytes;
+    frames += p->lead_frames;
+  }
+
+  int consumed = 0;
+  while (consumed < p->cut_count && p->cuts[consumed].time < cut - EPS)
+  {
+    bytes += p->gops[consumed].gop_bytes;
+    frames += p->gops[consumed].gop_frames;
+    c.keyframe_count++;
+    if (p->cuts[consumed].is_scene_cut)
+      c.scene_cut_count++;
+    consumed++;
+  }
+
+  c.bytes = bytes;
+  c.avg_complexity = online_complexity(p, bytes, frames);
+  c.quality_score = 1.0 - fabs(c.avg_complexity - 0.5);
+  if (c.keyframe_count > 0)
+    c.quality_score += 0.1;
+
+  p->ready.chunks[p->ready.count++] = c;
+
+  memmove(p->cuts, p->cuts + consumed, (p->cut_count - consumed) * sizeof(*p->cuts));
+  memmove(p->gops, p->gops + consumed, (p->cut_count - consumed) * sizeof(*p->gops));
+  p->cut_count -= consumed;
+  p->start = cut;
+  return SC_OK;
+}
+
+// Commit every chunk whose end can no longer move: a keyframe past
+// start + max_dur bounds the search, and every scene flag before it is
+// final. Near the hinted end, decisions wait for sc_online_finish so a
+// tiny tail can still be folded into its neighbour.
+static int online_decide(sc_online_planner *p)
+{
+  for (;;)
+  {
+    int trigger = -1;
+    for (int i = 0; i < p->cut_count; i++)
+    {
+      if (p->cuts[i].time > p->start + p->max_dur + EPS)
+      {
+        trigger = i;
+        break;
+      }
+    }
+    if (trigger < 0)
+      return SC_OK;
+
+    for (int i = 0; i < trigger; i++)
+    {
+      if (!p->gops[i].scene_ready)
+        return SC_OK;
+    }
+
+    int64_t cursor = 0;
+    double cut = choose_smart_cut(p->start, DBL_MAX,
+                                  p->target, p->min_dur, p->max_dur,
+                                  p->cuts, p->cut_count, &cursor,
+                                  p->complexity_weight, NULL);
+
+    if (p->duration_hint > 0.0 &&
+        cut > p->duration_hint - p->max_dur &&
+        cut < p->duration_hint + p->max_dur)
+      return SC_OK;
+
+    int r = online_emit(p, cut);
+    if (r != SC_OK)
+      return r;
+  }
+}
+
+int sc_online_push(sc_online_planner *p, const sc_frame_meta *frame)
+{
+  if (!p || !frame || p->finished)
+    return SC_ERR_INVAL;
+
+  int64_t size = frame->pkt_size;
+  if (p->frames_seen == 0 || size < p->min_size)
+    p->min_size = size;
+  if (p->frames_seen == 0 || size > p->max_size)
+    p->max_size = size;
+
+  if (frame->is_keyframe && frame->pts_time > p->start + EPS)
+  {
+    int r = online_add_cut(p, frame->pts_time);
+    if (r != SC_OK)
+      return r;
+  }
+  else if (frame->is_keyframe && p->cut_count == 0)
+  {
+    // Keyframe at the chunk start: it opens the chunk's first GOP
+    int r = online_add_cut(p, p->start);
+    if (r != SC_OK)
+      return r;
+  }
+
+  if (p->cut_count > 0)
+  {
+    p->gops[p->cut_count - 1].gop_bytes += size;
+    p->gops[p->cut_count - 1].gop_frames++;
+  }
+  else
+  {
+    p->lead_bytes += size;
+    p->lead_frames++;
+  }
+
+  // After the cut is added: a keyframe opens its own after-window, as
+  // in scene_ratio
+  if (p->use_scene)
+    online_scene_update(p, size);
+
+  p->ring[p->frames_seen % SCENE_WINDOW] = size;
+  p->frames_seen++;
+
+  return online_decide(p);
+}
+
+int sc_online_finish(sc_online_planner *p, double duration)
+{
+  if (!p || p->finished)
+    return SC_ERR_INVAL;
+  if (p->next_index == 0 && duration <= EPS)
+    return SC_ERR_INVAL;
+
+  // Windows still open at end of stream never qualify as scene cuts
+  for (int i = 0; i < p->cut_count; i++)
+    p->gops[i].scene_ready = 1;
+
+  int64_t cursor = 0;
+  while (p->start < duration - EPS)
+  {
+    double cut = choose_smart_cut(p->start, duration,
+                                  p->target, p->min_dur, p->max_dur,
+                                  p->cuts, p->cut_count, &cursor,
+                                  p->complexity_weight, NULL);
+    if (cut <= p->start + EPS)
+      cut = fmin(p->start + p->max_dur, duration);
+
+    int r = online_emit(p, cut);
+    if (r != SC_OK)
+      return r;
+    cursor = 0;
+  }
+
+  if (p->ready.count > p->ready_pos)
+    p->ready.chunks[p->ready.count - 1].end = duration;
+
+  // A tiny tail can only fold into a chunk the caller has not taken yet
+  if (p->cfg.avoid_tiny_last && p->ready.count - 2 >= p->ready_pos)
+    merge_tiny_tail(&p->ready, p->min_dur, duration);
+
+  p->finished = 1;
+  return SC_OK;
+}
+
+int sc_online_next(sc_online_planner *p, sc_chunk *chunk)
+{
+  if (!p || !chunk || p->ready_pos >= p->ready.count)
+    return 0;
+
+  *chunk = p->ready.chunks[p->ready_pos++];
+
+  // Everything handed out: recycle the queue so live runs stay bounded
+  if (p->ready_pos == p->ready.count)
+  {
+    p->ready.count = 0;
+    p->ready_pos = 0;
+  }
+  return 1;
+}
+
+void sc_online_free(sc_online_planner **p)
+{
+  if (!p || !*p)
+    return;
+  free((*p)->cuts);
+  free((*p)->gops);
+  sc_free_chunk_plan(&(*p)->ready);
+  free(*p);
+  *p = NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Streaming probe + plan                                             */
+/* ------------------------------------------------------------------ */
+static int stream_drain(sc_online_planner *p, sc_chunk_cb cb, void *opaque,
+                        sc_chunk_plan *out)
+{
+  sc_chunk c;
+  while (sc_online_next(p, &c))
+  {
+    if (out)
+    {
+      if (ensure_chunk_capacity(out, out->count + 1) != SC_OK)
+        return SC_ERR_NOMEM;
+      out->chunks[out->count++] = c;
+    }
+    if (cb && cb(&c, opaque) != 0)
+      return SC_ERR_ABORT;
+  }
+  return SC_OK;
+}
+
+int sc_plan_stream(const char *filename,
+                   sc_plan_config cfg,
+                   sc_chunk_cb cb,
+                   void *opaque,
+                   sc_chunk_plan *out)
+{
+  if (!filename)
+    return SC_ERR_INVAL;
+
+  if (out)
+    memset(out, 0, sizeof(*out));
+
+  AVFormatContext *fmt = NULL;
+  if (avformat_open_input(&fmt, filename, NULL, NULL) < 0)
+    return SC_ERR_FFMPEG;
+  if (avformat_find_stream_info(fmt, NULL) < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_FFMPEG;
+  }
+
+  int vstream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (vstream < 0)
+  {
+    avformat_close_input(&fmt);
+    return SC_ERR_NOSTREAM;
+  }
+
+  AVStream *st = fmt->streams[vstream];
+  AVRational tb = st->time_base;
+
+  double hint = 0.0;
+  if (fmt->duration > 0)
+    hint = fmt->duration / (double)AV_TIME_BASE;
+
+  sc_online_planner *p = NULL;
+  int r = sc_online_create(cfg, hint, &p);
+  if (r != SC_OK)
+  {
+    avformat_close_input(&fmt);
+    return r;
+  }
+
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt)
+  {
+    sc_online_free(&p);
+    avformat_close_input(&fmt);
+    return SC_ERR_NOMEM;
+  }
+
+  double best_end = 0.0;
+  while (r == SC_OK && av_read_frame(fmt, pkt) >= 0)
+  {
+    if (pkt->stream_index == vstream)
+    {
+      double pts = packet_time(pkt, tb, best_end);
+      double end = packet_end(pkt, tb, pts);
+
+      sc_frame_meta fm = {
+          .pts_time = pts,
+          .is_keyframe = (pkt->flags & AV_PKT_FLAG_KEY) ? 1 : 0,
+          .pkt_size = pkt->size,
+          .pict_type = (pkt->flags & AV_PKT_FLAG_KEY) ? PICT_TYPE_I : PICT_TYPE_UNKNOWN,
+          .complexity = 0.0,
+          .is_scene_cut = 0};
+
+      r = sc_online_push(p, &fm);
+      if (r == SC_OK)
+        r = stream_drain(p, cb, opaque, out);
+
+      if (end > best_end)
+        best_end = end;
+    }
+    av_packet_unref(pkt);
+  }
+
+  if (r == SC_OK)
+  {
+    if (best_end <= 0.0 && st->duration > 0)
+      best_end = st->duration * av_q2d(tb);
+    if (best_end <= 0.0)
+      best_end = hint;
+
+    r = sc_online_finish(p, best_end);
+    if (r == SC_OK)
+      r = stream_drain(p, cb, opaque, out);
+  }
+
+  av_packet_free(&pkt);
+  sc_online_free(&p);
+  avformat_close_input(&fmt);
+
+  if (r != SC_OK && out)
+    sc_free_chunk_plan(out);
+  return r;
 }
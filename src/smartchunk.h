@@ -20,6 +20,10 @@ extern "C"
     int pict_type;      // frame type: I=1, P=2, B=3, unknown=0
     double complexity;  // computed complexity score (0.0-1.0)
     int is_scene_cut;   // detected scene change
+    int frame_span;     // frames this entry stands for (GOP length in
+                        // keyframe-only probes; 0 is read as 1)
+    int open_gop;       // keyframe-only probes: a folded frame is shown
+                        // before the keyframe (leading picture)
   } sc_frame_meta;
 
   // ---------------------------------------------
@@ -28,11 +32,43 @@ extern "C"
   typedef struct
   {
     sc_frame_meta *frames;
-    int count;
-    int capacity;
-    double duration; // seconds
+    int64_t count;      // 64-bit: day-long high-frame-rate captures
+    int64_t capacity;
+    double duration;    // seconds
+    int keyframes_only; // frames[] holds one aggregate per GOP
+    double sample_error; // sc_probe_sampled: estimated mean relative error
+                         // of the GOP sizes (0 = exact, <0 = unknown)
+    int audio_only;      // frames[] are audio packets (SC_PROBE_AUDIO)
+    double audio_priming; // encoder delay at the stream start (sec)
+    double time_offset;   // sc_probe_range: source time of pts_time 0;
+                          // sc_plan_chunks adds it back to the plan
   } sc_probe_result;
 
+  // ---------------------------------------------
+  // GOP table: the planner's working unit. One entry per keyframe
+  // (plus a leading entry for frames before the first keyframe, which
+  // cannot be cut at).
+  // ---------------------------------------------
+  typedef struct
+  {
+    double start;        // pts of the GOP's first frame (sec)
+    int64_t first_frame; // index into sc_probe_result.frames
+    int64_t frame_count;
+    int64_t bytes;
+    double cost;         // mean frame complexity (0.0-1.0)
+    int is_keyframe;     // starts on a keyframe: a cut point
+    int closed;          // no leading pictures before the keyframe
+    int is_scene_cut;
+    double scene_score;  // relative size change across the keyframe
+  } sc_gop;
+
+  typedef struct
+  {
+    sc_gop *gops;
+    int64_t count;
+    int64_t capacity;
+  } sc_gop_table;
+
   // ---------------------------------------------
   // Chunk definition
   // ---------------------------------------------
@@ -45,6 +81,9 @@ extern "C"
     int keyframe_count;     // number of keyframes in chunk
     int scene_cut_count;    // number of scene changes in chunk
     double quality_score;   // overall quality score for this chunk
+    int64_t bytes;          // packet bytes of the chunk's GOPs (0 = unknown)
+    int node;               // hierarchical plans: node (macro chunk) it
+                            // belongs to; 0 otherwise
   } sc_chunk;
 
   // ---------------------------------------------
@@ -79,8 +118,42 @@ extern "C"
     int enable_balanced_dist;     // optimize distribution across all chunks
     double scene_threshold;       // scene detection sensitivity (0.0-1.0)
     double complexity_weight;     // how much to weight complexity (0.0-1.0)
+
+    // Content-defined boundaries: keyframes picked by a rolling hash of
+    // packet sizes within [min_dur, max_dur], so an edit only moves the
+    // cuts near it (batch planner only)
+    int enable_content_defined;
+
+    // Segment grid: only keyframes within grid_tol of a multiple of
+    // grid_dur past the first keyframe are cut candidates, so chunks map
+    // 1:1 onto packager segments. Where no grid keyframe lies within
+    // max_dur the nearest other keyframe is used (see
+    // sc_plan_grid_misses). Greedy planners only; 0 = off.
+    double grid_dur;
+    double grid_tol; // 0 = SC_GRID_DEFAULT_TOL
+
+    // Size target: chunks near target_bytes of packet data at keyframe
+    // boundaries (storage parts, multipart uploads). bytes_weight blends
+    // the size and duration distances: 1 or negative = size only, in
+    // which case target_dur is derived from the average bitrate; 0 =
+    // duration only, the size is just reported. target_bytes 0 = off.
+    int64_t target_bytes;
+    double bytes_weight;
+
+    // Two-level plan for a cluster: the source is split into `nodes`
+    // macro chunks of balanced work (frames, weighted by complexity with
+    // enable_complexity_adapt), and each of those into micro chunks for
+    // node_workers local workers: node_workers of them, or a multiple
+    // when target_dur asks for more. Every boundary is a keyframe. The
+    // plan holds the micro chunks, each tagged with its node (see
+    // sc_plan_nodes). min/max_dur, the grid, the size target and
+    // content-defined cuts do not apply. 0 = off.
+    int nodes;
+    int node_workers; // 0 = 1
   } sc_plan_config;
 
+#define SC_GRID_DEFAULT_TOL 0.05
+
 // ---------------------------------------------
 // Return codes
 // ---------------------------------------------
@@ -89,6 +162,7 @@ extern "C"
 #define SC_ERR_NOSTREAM -2
 #define SC_ERR_NOMEM -3
 #define SC_ERR_INVAL -4
+#define SC_ERR_ABORT -5
 
   // ---------------------------------------------
   // API
@@ -96,8 +170,89 @@ extern "C"
 
   // Fast probe using packet metadata (no decoding)
   int sc_probe_video(const char *filename, sc_probe_result *out);
+
+  // Keep one entry per GOP (keyframe pts, summed bytes, frame_span)
+  // instead of one per frame: memory scales with the keyframe count.
+  // Enough for the plain keyframe planner; scene/complexity analysis
+  // then works on GOP aggregates.
+#define SC_PROBE_KEYFRAMES_ONLY 0x1
+
+  // Probe MPEG-TS/M2TS with the native packet scanner (sc_probe_ts)
+  // instead of libavformat; other inputs still go through the demuxer
+#define SC_PROBE_NATIVE_TS 0x2
+
+  // Inputs without video: probe the best audio stream instead of failing
+  // with SC_ERR_NOSTREAM. Every packet is a codec frame and a cut point.
+#define SC_PROBE_AUDIO 0x4
+
+  int sc_probe_video_ex(const char *filename, int flags, sc_probe_result *out);
+
+  // Clip mode: probe only [from, to) of the source. The demuxer seeks to
+  // the keyframe at or before from and stops at the first keyframe at or
+  // after to, so the work scales with the clip. Frames are relative to
+  // from (time_offset) and duration is the clip length; plans made from
+  // the result are in source time again, starting at from and ending at
+  // to; stream copy still takes the last chunk's video on to the first
+  // keyframe at or after to. SC_PROBE_NATIVE_TS is ignored.
+  int sc_probe_range(const char *filename, int flags, double from, double to,
+                     sc_probe_result *out);
+
+  // Coarse probe for very large inputs: keyframes come from the
+  // container index, packet sizes from bursts every stride_sec seconds
+  // (default 60 s), interpolated over each GOP. A burst reads whole
+  // GOPs: from a keyframe to the first keyframe after burst_frames
+  // frames (default 30), so I-frames weigh in at their real share.
+  // Indexes listing every sample (MP4/MOV) give exact sizes without
+  // reading payloads; inputs with no index at all fall back to a full
+  // keyframe-only scan. The result is keyframe-only; leading pictures
+  // are never seen, so open_gop stays 0.
+  int sc_probe_sampled(const char *filename,
+                       double stride_sec,
+                       int burst_frames,
+                       sc_probe_result *out);
+
+  // Native MPEG-TS scanner (tsprobe.c): parses only adaptation fields and
+  // PES headers on the first video PID; PES sizes come from payload
+  // lengths. Returns SC_ERR_INVAL when the file is not a transport
+  // stream or carries no random_access_indicator, so callers can fall
+  // back to sc_probe_video_ex.
+  int sc_probe_ts(const char *filename, int flags, sc_probe_result *out);
   void sc_free_probe(sc_probe_result *res);
 
+  // ---------------------------------------------
+  // Multi-file timeline: sequential files (card spans, recording
+  // rollovers) probed as one program. File i's frames are placed at
+  // pts - origin + offset, and each file starts where the previous one
+  // ended, so the planner balances chunks over the whole program and a
+  // chunk may span a file boundary (split_output_mode.timeline).
+  // ---------------------------------------------
+  typedef struct
+  {
+    char *path;
+    double offset; // timeline time of the file's first frame
+    double origin; // the file's own first timestamp (0 for file 0)
+  } sc_timeline_file;
+
+  typedef struct
+  {
+    sc_timeline_file *files;
+    int count;
+  } sc_timeline;
+
+  // Slack for the offset round trip when mapping cuts back into a file
+#define SC_TIMELINE_EPS 1e-6
+
+  // Probe every file (sc_probe_video_ex flags) into one result; all
+  // files must be audio-only or none
+  int sc_probe_timeline(const char *const *filenames, int n, int flags,
+                        sc_probe_result *out, sc_timeline *tl);
+  void sc_free_timeline(sc_timeline *tl);
+
+  // Group probed frames into GOPs (sc_plan_chunks does this itself;
+  // exposed for tools that want the table)
+  int sc_build_gop_table(const sc_probe_result *m, sc_gop_table *out);
+  void sc_free_gop_table(sc_gop_table *t);
+
   // Smart chunk planning
   int sc_plan_chunks(const sc_probe_result *meta,
                      sc_plan_config cfg,
@@ -105,6 +260,114 @@ extern "C"
 
   void sc_free_chunk_plan(sc_chunk_plan *plan);
 
+  // Macro level of a hierarchical plan: one chunk per node spanning its
+  // micro chunks (index = node), with their counts and bytes summed
+  int sc_plan_nodes(const sc_chunk_plan *plan, sc_chunk_plan *out);
+
+  // Segment grid: the effective tolerance, and the number of cuts of a
+  // plan that are off the grid because the GOP structure allowed none.
+  // meta is the probe the plan was made from; the grid starts at its
+  // first keyframe (NULL = at 0).
+  double sc_grid_tolerance(sc_plan_config cfg);
+  int sc_plan_grid_misses(const sc_chunk_plan *plan, const sc_probe_result *meta,
+                          sc_plan_config cfg);
+
+  // Stable 64-bit fingerprint of a plan's boundaries (millisecond
+  // resolution), used to tie chunk files back to the plan that made them
+  uint64_t sc_plan_hash(const sc_chunk_plan *plan);
+
+  // ---------------------------------------------
+  // Multi-rendition planning: one set of cuts valid for every input of
+  // an ABR ladder. A reference keyframe (input 0) is a cut candidate
+  // only when every other input has a keyframe within tolerance of it;
+  // the cut then sits on the earliest of those keyframes, so each
+  // rendition's chunks start on its own keyframe. The report lists the
+  // cuts input 0 would have chosen alone that an input lacked.
+  // ---------------------------------------------
+  typedef struct
+  {
+    int input;     // rendition without a keyframe near the wanted cut
+    double wanted; // cut the reference alone would have used
+    double actual; // nearest cut of the aligned plan
+  } sc_align_move;
+
+  typedef struct
+  {
+    sc_align_move *moves;
+    int count;
+    int capacity;
+    int common_keyframes; // reference keyframes shared by every input
+  } sc_align_report;
+
+  // Plan over probes that are already loaded (report may be NULL)
+  int sc_plan_chunks_aligned(const sc_probe_result *probes, int n,
+                             sc_plan_config cfg, double tolerance,
+                             sc_chunk_plan *out, sc_align_report *report);
+
+  // Probe the n inputs in parallel (sc_probe_video_ex flags), then plan
+  int sc_plan_chunks_multi(const char *const *filenames, int n, int probe_flags,
+                           sc_plan_config cfg, double tolerance,
+                           sc_chunk_plan *out, sc_align_report *report);
+  void sc_free_align_report(sc_align_report *r);
+
+  // ---------------------------------------------
+  // Edit decision lists: extract given ranges instead of covering the
+  // whole source. Ranges are sorted, widened to keyframes (start to the
+  // keyframe at or before it, end to the one at or after it, so stream
+  // copy loses nothing) and merged where they then overlap. The plan
+  // holds one chunk per resulting range; gaps between chunks are not
+  // part of the output.
+  // ---------------------------------------------
+  typedef struct
+  {
+    double start;
+    double end;
+  } sc_range;
+
+  // Probe for sc_plan_ranges that reads only around the ranges: each
+  // one is entered by a backward seek (so the keyframe at or before its
+  // start is seen) and left at the first keyframe at or after its end.
+  // The result is keyframe-only on the source clock, its duration taken
+  // from the container. SC_PROBE_AUDIO as for sc_probe_video_ex.
+  int sc_probe_ranges(const char *filename, int flags, const sc_range *ranges, int n,
+                      sc_probe_result *out);
+  int sc_plan_ranges(const sc_probe_result *m, const sc_range *ranges, int n,
+                     sc_chunk_plan *out);
+
+  // ---------------------------------------------
+  // Online planner: the streaming counterpart of sc_plan_chunks.
+  // Frames are pushed in decode order and a chunk is released as soon
+  // as its end can no longer move (a keyframe beyond start + max_dur has
+  // arrived and the scene flags before it are final), so lookahead is
+  // bounded by max_dur. duration_hint (0 if unknown) drives
+  // ideal_parallel and holds back the last max_dur so avoid_tiny_last
+  // still applies; without it a tiny tail is only merged when both
+  // chunks are decided by sc_online_finish.
+  // ---------------------------------------------
+  typedef struct sc_online_planner sc_online_planner;
+
+  int sc_online_create(sc_plan_config cfg, double duration_hint,
+                       sc_online_planner **out);
+  int sc_online_push(sc_online_planner *p, const sc_frame_meta *frame);
+  int sc_online_finish(sc_online_planner *p, double duration);
+
+  // 1 when a decided chunk was returned, 0 when none is ready yet
+  int sc_online_next(sc_online_planner *p, sc_chunk *chunk);
+  void sc_online_free(sc_online_planner **p);
+
+  // Called for each chunk as soon as its end is final; non-zero aborts
+  typedef int (*sc_chunk_cb)(const sc_chunk *chunk, void *opaque);
+
+  // Probe and plan in one pass over the file, handing chunks to cb while
+  // the probe is still running (the first one arrives after roughly
+  // max_dur of demuxing). The whole plan is also returned in out when it
+  // is non-NULL. Cuts are chosen as sc_plan_chunks would choose them.
+  int sc_plan_stream(const char *filename,
+                     sc_plan_config cfg,
+                     sc_chunk_cb cb,
+                     void *opaque,
+                     sc_chunk_plan *out);
+
 #ifdef __cplusplus
 }
 #endif
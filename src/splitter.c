@@ -1,5 +1,9 @@
 #include "splitter.h"
+#include "chunkpack.h"
+#include "followio.h"
 #include <errno.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +18,7 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/sha.h>
 #include <libavutil/timestamp.h>
 
 // ---------------------------------------------------------
@@ -51,96 +56,27 @@ static const char *detect_output_fmt(const char *input)
 }
 
 // ---------------------------------------------------------
-// Split a single chunk
+// Muxer short name for chunk files
 // ---------------------------------------------------------
-int split_one_chunk(const char *input,
-                    const sc_chunk *chunk,
-                    const char *output_file,
-                    const split_output_mode *mode)
+static const char *chunk_output_fmt(const char *input,
+                                    const split_output_mode *cfg)
 {
-  int rc = SPLIT_OK;
-
-  AVFormatContext *in_fmt = NULL;
-  AVFormatContext *out_fmt = NULL;
-  const AVOutputFormat *ofmt = NULL;
-  int *stream_map = NULL;
-  AVPacket *pkt = NULL;
-  AVDictionary *mux_opts = NULL;
-  int64_t *pts_base = NULL;
-  int64_t *dts_base = NULL;
-  int64_t *last_pts = NULL;
-  int64_t *last_dts = NULL;
-  int *stream_ended = NULL;
-
-  const split_output_mode default_mode = {
-      .auto_mode = 1,
-      .force_fmt = NULL,
-      .output_frag = 0};
-  const split_output_mode *cfg = mode ? mode : &default_mode;
-
-  // -----------------------------
-  // Open input file
-  // -----------------------------
-  if (avformat_open_input(&in_fmt, input, NULL, NULL) < 0)
-    return SPLIT_ERR_OPEN;
-
-  if (avformat_find_stream_info(in_fmt, NULL) < 0)
-  {
-    rc = SPLIT_ERR_FFMPEG;
-    goto cleanup;
-  }
-
-  // -----------------------------
-  // Select output container
-  // -----------------------------
-  const char *fmt_name = NULL;
-
   if (cfg->auto_mode)
-    fmt_name = detect_output_fmt(input);
-  else if (cfg->force_fmt)
-    fmt_name = cfg->force_fmt;
-  else
-    fmt_name = "mp4";
-
-  ofmt = av_guess_format(fmt_name, NULL, NULL);
-  if (!ofmt)
-  {
-    rc = SPLIT_ERR_OUTPUT;
-    goto cleanup;
-  }
-
-  if (avformat_alloc_output_context2(&out_fmt, ofmt, fmt_name, output_file) < 0)
-  {
-    rc = SPLIT_ERR_OUTPUT;
-    goto cleanup;
-  }
-
-  // Enable fMP4 mode if requested
-  if (cfg->output_frag && !strcmp(fmt_name, "mp4"))
-  {
-    av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+omit_tfhd_offset", 0);
-  }
-
-  // -----------------------------
-  // Create output streams
-  // -----------------------------
-  stream_map = calloc(in_fmt->nb_streams, sizeof(int));
-  if (!stream_map)
-  {
-    rc = SPLIT_ERR_NOMEM;
-    goto cleanup;
-  }
-
-  const unsigned in_stream_count = in_fmt->nb_streams;
-  last_pts = malloc(sizeof(int64_t) * in_stream_count);
-  last_dts = malloc(sizeof(int64_t) * in_stream_count);
-  if (!last_pts || !last_dts)
-  {
-    rc = SPLIT_ERR_NOMEM;
-    goto cleanup;
-  }
+    return detect_output_fmt(input);
+  if (cfg->force_fmt)
+    return cfg->force_fmt;
+  return "mp4";
+}
 
-  for (unsigned i = 0; i < in_stream_count; i++)
+// ---------------------------------------------------------
+// Mirror the input streams (minus attachments) in out_fmt;
+// stream_map[in] = out index or -1
+// ---------------------------------------------------------
+static int map_output_streams(AVFormatContext *in_fmt,
+                              AVFormatContext *out_fmt,
+                              int *stream_map)
+{
+  for (unsigned i = 0; i < in_fmt->nb_streams; i++)
   {
     AVStream *ist = in_fmt->streams[i];
     AVCodecParameters *ip = ist->codecpar;
@@ -153,80 +89,218 @@ int split_one_chunk(const char *input,
 
     AVStream *ost = avformat_new_stream(out_fmt, NULL);
     if (!ost)
-    {
-      rc = SPLIT_ERR_STREAM;
-      goto cleanup;
-    }
+      return SPLIT_ERR_STREAM;
 
     if (avcodec_parameters_copy(ost->codecpar, ip) < 0)
-    {
-      rc = SPLIT_ERR_STREAM;
-      goto cleanup;
-    }
+      return SPLIT_ERR_STREAM;
 
     ost->codecpar->codec_tag = 0;
     ost->time_base = ist->time_base;
 
     stream_map[i] = ost->index;
   }
+  return SPLIT_OK;
+}
 
-  // -----------------------------
-  // Open output file
-  // -----------------------------
-  if (!(out_fmt->oformat->flags & AVFMT_NOFILE))
-  {
-    if (avio_open(&out_fmt->pb, output_file, AVIO_FLAG_WRITE) < 0)
-    {
-      rc = SPLIT_ERR_OUTPUT;
-      goto cleanup;
-    }
-  }
+// ---------------------------------------------------------
+// Describe the chunk in its own container metadata
+// ---------------------------------------------------------
+static void tag_chunk(AVDictionary **md,
+                      const sc_chunk *chunk,
+                      const split_output_mode *cfg,
+                      double preroll)
+{
+  char buf[32];
 
-  if (avformat_write_header(out_fmt, &mux_opts) < 0)
+  snprintf(buf, sizeof(buf), "%d", chunk->index);
+  av_dict_set(md, SPLIT_TAG_INDEX, buf, 0);
+  snprintf(buf, sizeof(buf), "%d", cfg->chunk_count);
+  av_dict_set(md, SPLIT_TAG_COUNT, buf, 0);
+  snprintf(buf, sizeof(buf), "%.6f", chunk->start);
+  av_dict_set(md, SPLIT_TAG_START, buf, 0);
+  snprintf(buf, sizeof(buf), "%.6f", chunk->end);
+  av_dict_set(md, SPLIT_TAG_END, buf, 0);
+  snprintf(buf, sizeof(buf), "%016" PRIx64, cfg->plan_hash);
+  av_dict_set(md, SPLIT_TAG_PLAN, buf, 0);
+  if (preroll > 0.0)
   {
-    rc = SPLIT_ERR_WRITE;
-    goto cleanup;
+    snprintf(buf, sizeof(buf), "%.6f", preroll);
+    av_dict_set(md, SPLIT_TAG_PREROLL, buf, 0);
   }
+}
 
-  // -----------------------------
-  // Seek to beginning of chunk
-  // -----------------------------
-  double start_pts = chunk->start;
-  int64_t seek_ts = start_pts * AV_TIME_BASE;
+// ---------------------------------------------------------
+// Content-addressed store: a chunk is named by the digest of
+// the packets it copies (payload, flags and timing relative to
+// each stream's first packet) and of the mux settings, so the
+// same content cut from another delivery into the same kind of
+// file maps to the same object
+// ---------------------------------------------------------
+typedef struct
+{
+  struct AVSHA *all;   // mux settings, then every packet: store key
+  struct AVSHA *video; // video packets alone: encode cache key
+  int64_t *base;       // first dts (or pts) per input stream
+  unsigned nb_streams;
+} split_digest;
 
-  if (av_seek_frame(in_fmt, -1, seek_ts, AVSEEK_FLAG_BACKWARD) < 0)
-  {
-    rc = SPLIT_ERR_SEEK;
-    goto cleanup;
-  }
+static void put_be64(uint8_t *p, uint64_t v)
+{
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (56 - 8 * i));
+}
 
-  // -----------------------------
-  // Copy packets
-  // -----------------------------
-  pkt = av_packet_alloc();
-  if (!pkt)
-  {
-    rc = SPLIT_ERR_NOMEM;
-    goto cleanup;
-  }
+static int digest_init(split_digest *d, unsigned nb_streams,
+                       const char *fmt_name, int frag)
+{
+  d->all = av_sha_alloc();
+  d->video = av_sha_alloc();
+  d->base = malloc(sizeof(int64_t) * (nb_streams ? nb_streams : 1));
+  d->nb_streams = nb_streams;
+  if (!d->all || !d->video || !d->base)
+    return SPLIT_ERR_NOMEM;
+  av_sha_init(d->all, 256);
+  av_sha_init(d->video, 256);
+  for (unsigned i = 0; i < nb_streams; i++)
+    d->base[i] = AV_NOPTS_VALUE;
+
+  // A Matroska or fragmented object must not stand in for plain MP4
+  uint8_t flag = frag ? 1 : 0;
+  av_sha_update(d->all, (const uint8_t *)fmt_name, strlen(fmt_name) + 1);
+  av_sha_update(d->all, &flag, 1);
+  return SPLIT_OK;
+}
 
-  double end_pts = chunk->end;
-  pts_base = calloc(in_stream_count, sizeof(int64_t));
-  dts_base = calloc(in_stream_count, sizeof(int64_t));
-  stream_ended = calloc(in_stream_count, sizeof(int));
-  if (!pts_base || !dts_base || !stream_ended)
+// Timing is hashed in a fixed 90 kHz base so containers that store
+// the same stream with different time bases still agree
+static void digest_packet(split_digest *d, const AVStream *ist, const AVPacket *pkt)
+{
+  const AVRational hash_tb = {1, 90000};
+  int si = pkt->stream_index;
+  int64_t ref = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+  if (d->base[si] == AV_NOPTS_VALUE && ref != AV_NOPTS_VALUE)
+    d->base[si] = ref;
+  int64_t rel_pts = pkt->pts == AV_NOPTS_VALUE || d->base[si] == AV_NOPTS_VALUE
+                        ? INT64_MIN
+                        : av_rescale_q(pkt->pts - d->base[si], ist->time_base, hash_tb);
+  int64_t rel_dts = pkt->dts == AV_NOPTS_VALUE || d->base[si] == AV_NOPTS_VALUE
+                        ? INT64_MIN
+                        : av_rescale_q(pkt->dts - d->base[si], ist->time_base, hash_tb);
+
+  uint8_t hdr[32];
+  put_be64(hdr + 8, ((uint64_t)(pkt->flags & AV_PKT_FLAG_KEY) << 32) | (uint32_t)pkt->size);
+  put_be64(hdr + 16, (uint64_t)rel_pts);
+  put_be64(hdr + 24, (uint64_t)rel_dts);
+
+  put_be64(hdr, (uint64_t)si);
+  av_sha_update(d->all, hdr, sizeof(hdr));
+  av_sha_update(d->all, pkt->data, (size_t)pkt->size);
+  if (ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
   {
-    rc = SPLIT_ERR_NOMEM;
-    goto cleanup;
+    put_be64(hdr, 0);
+    av_sha_update(d->video, hdr, sizeof(hdr));
+    av_sha_update(d->video, pkt->data, (size_t)pkt->size);
   }
+}
+
+static void sha_hex(struct AVSHA *sha, char out[65])
+{
+  uint8_t d[32];
+  av_sha_final(sha, d);
+  for (int i = 0; i < 32; i++)
+    snprintf(out + 2 * i, 3, "%02x", d[i]);
+}
+
+static void digest_free(split_digest *d)
+{
+  av_free(d->all);
+  av_free(d->video);
+  free(d->base);
+  memset(d, 0, sizeof(*d));
+}
+
+// ---------------------------------------------------------
+// Where a chunk's bytes go besides a plain file
+// ---------------------------------------------------------
+typedef struct
+{
+  chunkpack *pack; /* append to this pack */
+  int to_mem;      /* capture the whole CMAF fMP4 in mem/mem_size */
+  uint8_t *mem;
+  int mem_size;
+  split_digest *digest; /* store object: hash what is copied, start the
+                           timestamps at the copy start and put the plan
+                           tags in tags instead of the file */
+  AVDictionary *tags;
+} split_sink;
+
+// ---------------------------------------------------------
+// Split a single chunk (into output_file, or into the sink
+// when one is given)
+// ---------------------------------------------------------
+// First timestamp a chunk copies. Audio-only inputs are cut on any
+// packet; the first chunk keeps priming packets that sit before zero and
+// later chunks start audio_preroll early so the encoder is warmed up by
+// the time the chunk proper begins (stitch_input_mode.audio_preroll
+// trims that head again).
+static double chunk_copy_from(AVFormatContext *in_fmt, const sc_chunk *chunk,
+                              double audio_preroll)
+{
+  if (av_find_best_stream(in_fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0) >= 0)
+    return chunk->start;
+  if (chunk->start <= 0.0)
+    return -INFINITY;
+  return chunk->start - (audio_preroll > 0.0 ? audio_preroll : 0.0);
+}
+
+// Pre-roll a chunk copied from copy_from really holds: none for video
+// inputs and the first chunk, and no more than lies before its start
+static double chunk_preroll(const sc_chunk *chunk, double copy_from)
+{
+  if (!isfinite(copy_from) || copy_from >= chunk->start)
+    return 0.0;
+  return chunk->start - fmax(copy_from, 0.0);
+}
+
+// A clip's first chunk (split_output_mode.clip_from) starts between
+// keyframes: its video is taken from the keyframe before the start so
+// nothing of the clip is lost
+static int chunk_lead_in(const sc_chunk *chunk, const split_output_mode *cfg)
+{
+  return cfg->clip_from > 0.0 && fabs(chunk->start - cfg->clip_from) < SC_TIMELINE_EPS;
+}
+
+// ---------------------------------------------------------
+// Copy the packets of one input in [from, to) to out_fmt:
+// video from the first keyframe at or after from (lead_in: the
+// keyframe at or before it) up to the first keyframe at or
+// after to, other streams by timestamp. shift (sec) moves
+// them onto the output timeline. digest, when set, hashes
+// every copied packet.
+// ---------------------------------------------------------
+static int copy_range(AVFormatContext *in_fmt,
+                      AVFormatContext *out_fmt,
+                      const int *stream_map,
+                      double from,
+                      double to,
+                      double shift,
+                      int lead_in,
+                      split_digest *digest)
+{
+  int rc = SPLIT_OK;
+  const unsigned in_stream_count = in_fmt->nb_streams;
+
+  int64_t seek_ts = (from > 0.0 ? from : 0.0) * AV_TIME_BASE;
+  if (av_seek_frame(in_fmt, -1, seek_ts, AVSEEK_FLAG_BACKWARD) < 0)
+    return SPLIT_ERR_SEEK;
 
-  for (unsigned i = 0; i < in_stream_count; i++)
+  AVPacket *pkt = av_packet_alloc();
+  int *stream_ended = calloc(in_stream_count, sizeof(int));
+  if (!pkt || !stream_ended)
   {
-    pts_base[i] = AV_NOPTS_VALUE;
-    dts_base[i] = AV_NOPTS_VALUE;
-    last_pts[i] = AV_NOPTS_VALUE;
-    last_dts[i] = AV_NOPTS_VALUE;
-    stream_ended[i] = 0;
+    av_packet_free(&pkt);
+    free(stream_ended);
+    return SPLIT_ERR_NOMEM;
   }
 
   int first_keyframe_found = 0;
@@ -259,14 +333,14 @@ int split_one_chunk(const char *input,
     {
       if (ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
       {
-        if (!(pkt->flags & AV_PKT_FLAG_KEY) || ts < start_pts)
+        if (!(pkt->flags & AV_PKT_FLAG_KEY) || (ts < from && !lead_in))
         {
           av_packet_unref(pkt);
           continue;
         }
         first_keyframe_found = 1;
       }
-      else if (ts < start_pts)
+      else if (ts < from)
       {
         av_packet_unref(pkt);
         continue;
@@ -275,7 +349,7 @@ int split_one_chunk(const char *input,
 
     // Stop when video hits a keyframe at/past the boundary
     // Mark video as ended but continue processing other streams
-    if (ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && ts >= end_pts && (pkt->flags & AV_PKT_FLAG_KEY))
+    if (ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && ts >= to && (pkt->flags & AV_PKT_FLAG_KEY))
     {
       video_ended = 1;
       stream_ended[in_si] = 1;
@@ -292,7 +366,7 @@ int split_one_chunk(const char *input,
 
     // For non-video streams, stop when timestamp exceeds boundary
     // This ensures all audio packets within the range are included
-    if (ist->codecpar->codec_type != AVMEDIA_TYPE_VIDEO && ts >= end_pts)
+    if (ist->codecpar->codec_type != AVMEDIA_TYPE_VIDEO && ts >= to)
     {
       stream_ended[in_si] = 1;
       av_packet_unref(pkt);
@@ -317,19 +391,25 @@ int split_one_chunk(const char *input,
 
     AVStream *ost = out_fmt->streams[out_si];
 
+    if (digest)
+      digest_packet(digest, ist, pkt);
+
     // For bit-perfect reconstruction, we DON'T rebase timestamps at all
-    // Just copy packets exactly as they are
+    // Just copy packets exactly as they are (a timeline file is only
+    // moved to its place on the timeline)
     // The stitcher will handle timeline continuity
+    if (shift != 0.0)
+    {
+      int64_t d = av_rescale_q(llrint(shift * AV_TIME_BASE), AV_TIME_BASE_Q, ist->time_base);
+      if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts += d;
+      if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts += d;
+    }
 
     // Rescale timestamps from input to output timebase
     av_packet_rescale_ts(pkt, ist->time_base, ost->time_base);
 
-    // Track last values in output timebase
-    if (pkt->pts != AV_NOPTS_VALUE)
-      last_pts[out_si] = pkt->pts;
-    if (pkt->dts != AV_NOPTS_VALUE)
-      last_dts[out_si] = pkt->dts;
-
     pkt->pos = -1;
     pkt->stream_index = out_si;
 
@@ -343,68 +423,1303 @@ int split_one_chunk(const char *input,
     av_packet_unref(pkt);
   }
 
-  av_write_trailer(out_fmt);
-
-cleanup:
-  if (pkt)
-    av_packet_free(&pkt);
-
-  if (out_fmt && !(out_fmt->oformat->flags & AVFMT_NOFILE))
-    avio_closep(&out_fmt->pb);
-
-  if (out_fmt)
-    avformat_free_context(out_fmt);
-
-  if (in_fmt)
-    avformat_close_input(&in_fmt);
-
-  free(stream_map);
-  av_dict_free(&mux_opts);
-  free(pts_base);
-  free(dts_base);
-  free(last_pts);
-  free(last_dts);
+  av_packet_free(&pkt);
   free(stream_ended);
-
   return rc;
 }
 
 // ---------------------------------------------------------
-// Split all chunks (single-threaded version)
-// (Threaded version exists in chunkify_cli)
+// Multi-file timeline: the file a timeline time falls in
 // ---------------------------------------------------------
-int split_all_chunks(const char *input,
-                     const sc_chunk_plan *plan,
-                     const char *outdir,
-                     const split_output_mode *mode)
+static int timeline_file_at(const sc_timeline *tl, double t)
 {
-  if (!plan || plan->count <= 0)
-    return SPLIT_OK;
+  int i = 0;
+  while (i + 1 < tl->count && tl->files[i + 1].offset <= t)
+    i++;
+  return i;
+}
 
-  if (!mkdir_if_needed(outdir))
+// Same streams in the same order: packets map through one stream_map
+static int same_layout(const AVFormatContext *a, const AVFormatContext *b)
+{
+  if (a->nb_streams != b->nb_streams)
+    return 0;
+  for (unsigned i = 0; i < a->nb_streams; i++)
   {
-    fprintf(stderr, "mkdir failed: %s\n", outdir);
-    return SPLIT_ERR_OUTPUT;
+    const AVCodecParameters *pa = a->streams[i]->codecpar;
+    const AVCodecParameters *pb = b->streams[i]->codecpar;
+    if (pa->codec_type != pb->codec_type || pa->codec_id != pb->codec_id)
+      return 0;
   }
+  return 1;
+}
 
-  char outpath[512];
-
-  for (int i = 0; i < plan->count; i++)
+// Copy [from, to) of the timeline, reading every file it overlaps.
+// in_fmt is the already open file `opened`.
+static int copy_timeline(const sc_timeline *tl,
+                         AVFormatContext *in_fmt,
+                         int opened,
+                         AVFormatContext *out_fmt,
+                         const int *stream_map,
+                         double from,
+                         double to)
+{
+  for (int i = 0; i < tl->count; i++)
   {
-    const sc_chunk *c = &plan->chunks[i];
-
-    snprintf(outpath, sizeof(outpath),
-             "%s/chunk_%04d.mp4", outdir, c->index);
+    const sc_timeline_file *f = &tl->files[i];
+    double t0 = f->offset;
+    double t1 = i + 1 < tl->count ? tl->files[i + 1].offset : INFINITY;
+    if (t1 <= from || t0 >= to)
+      continue;
 
-    fprintf(stderr, "[split] %s (%.3f → %.3f)\n",
-            outpath, c->start, c->end);
+    // Local times; later files are entered at their first frame. The
+    // epsilon absorbs the round trip through the timeline offset.
+    double shift = f->offset - f->origin;
+    double eps = i > 0 ? SC_TIMELINE_EPS : 0.0;
+    double lfrom = (from > t0 || i == 0) ? from - shift - eps : f->origin - eps;
+    double lto = (t1 < to ? t1 : to) - shift - eps;
 
-    int r = split_one_chunk(input, c, outpath, mode);
-    if (r != SPLIT_OK)
+    AVFormatContext *fmt = in_fmt;
+    if (i != opened)
     {
-      fprintf(stderr, "split_one_chunk failed: %d\n", r);
-      return r;
+      fmt = NULL;
+      if (avformat_open_input(&fmt, f->path, NULL, NULL) < 0)
+        return SPLIT_ERR_OPEN;
+      if (avformat_find_stream_info(fmt, NULL) < 0)
+      {
+        avformat_close_input(&fmt);
+        return SPLIT_ERR_FFMPEG;
+      }
+      if (!same_layout(in_fmt, fmt))
+      {
+        fprintf(stderr, "%s: streams differ from %s\n", f->path, tl->files[opened].path);
+        avformat_close_input(&fmt);
+        return SPLIT_ERR_STREAM;
+      }
     }
+
+    int rc = copy_range(fmt, out_fmt, stream_map, lfrom, lto, shift, 0, NULL);
+    if (fmt != in_fmt)
+      avformat_close_input(&fmt);
+    if (rc != SPLIT_OK)
+      return rc;
   }
   return SPLIT_OK;
 }
+
+static int split_chunk_to(const char *input,
+                          const sc_chunk *chunk,
+                          const char *output_file,
+                          const split_output_mode *mode,
+                          split_sink *sink)
+{
+  int rc = SPLIT_OK;
+
+  AVFormatContext *in_fmt = NULL;
+  AVFormatContext *out_fmt = NULL;
+  const AVOutputFormat *ofmt = NULL;
+  int *stream_map = NULL;
+  AVDictionary *mux_opts = NULL;
+
+  const split_output_mode default_mode = {
+      .auto_mode = 1,
+      .force_fmt = NULL,
+      .output_frag = 0,
+      .chunk_count = 0,
+      .plan_hash = 0,
+      .pack_output = 0,
+      .cmaf_output = 0};
+  const split_output_mode *cfg = mode ? mode : &default_mode;
+  chunkpack *pack = sink ? sink->pack : NULL;
+  const int to_mem = sink && sink->to_mem;
+
+  // -----------------------------
+  // Open input file (on a timeline: the file the chunk starts in)
+  // -----------------------------
+  const sc_timeline *tl = cfg->timeline;
+  int opened = tl ? timeline_file_at(tl, chunk->start) : 0;
+  if (avformat_open_input(&in_fmt, tl ? tl->files[opened].path : input, NULL, NULL) < 0)
+    return SPLIT_ERR_OPEN;
+
+  if (avformat_find_stream_info(in_fmt, NULL) < 0)
+  {
+    rc = SPLIT_ERR_FFMPEG;
+    goto cleanup;
+  }
+
+  // -----------------------------
+  // Select output container
+  // -----------------------------
+  const char *fmt_name = NULL;
+
+  if (to_mem)
+    fmt_name = "mp4";
+  else
+    fmt_name = chunk_output_fmt(input, cfg);
+
+  ofmt = av_guess_format(fmt_name, NULL, NULL);
+  if (!ofmt)
+  {
+    rc = SPLIT_ERR_OUTPUT;
+    goto cleanup;
+  }
+
+  if (avformat_alloc_output_context2(&out_fmt, ofmt, fmt_name, output_file) < 0)
+  {
+    rc = SPLIT_ERR_OUTPUT;
+    goto cleanup;
+  }
+
+  // Store objects carry no plan tags (sink->tags gets them)
+  const int tagged = cfg->chunk_count > 0;
+  split_digest *digest = sink ? sink->digest : NULL;
+  const int file_tags = tagged && !digest;
+  if (digest && digest_init(digest, in_fmt->nb_streams, fmt_name, cfg->output_frag) != SPLIT_OK)
+  {
+    rc = SPLIT_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  // Enable fMP4 mode if requested
+  if (to_mem)
+  {
+    // CMAF fragments: moof-relative offsets, tfdt kept on the source
+    // timeline (frag_discont) so chunk N+1 continues where N stopped,
+    // and no mfra so the media part is just moof/mdat pairs
+    av_dict_set(&mux_opts, "movflags",
+                "frag_keyframe+empty_moov+default_base_moof+frag_discont+skip_trailer+cmaf", 0);
+  }
+  else if (cfg->output_frag && !strcmp(fmt_name, "mp4"))
+  {
+    av_dict_set(&mux_opts, "movflags",
+                file_tags ? "frag_keyframe+empty_moov+omit_tfhd_offset+use_metadata_tags"
+                          : "frag_keyframe+empty_moov+omit_tfhd_offset",
+                0);
+  }
+  else if (file_tags && (!strcmp(fmt_name, "mp4") || !strcmp(fmt_name, "mov")))
+  {
+    // mov/mp4 drop unknown keys unless written as mdta tags
+    av_dict_set(&mux_opts, "movflags", "use_metadata_tags", 0);
+  }
+
+  const double start_pts = chunk_copy_from(in_fmt, chunk, cfg->audio_preroll);
+  if (tagged)
+    tag_chunk(digest ? &sink->tags : &out_fmt->metadata, chunk, cfg,
+              chunk_preroll(chunk, start_pts));
+
+  // -----------------------------
+  // Create output streams
+  // -----------------------------
+  stream_map = calloc(in_fmt->nb_streams, sizeof(int));
+  if (!stream_map)
+  {
+    rc = SPLIT_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  rc = map_output_streams(in_fmt, out_fmt, stream_map);
+  if (rc != SPLIT_OK)
+    goto cleanup;
+
+  // -----------------------------
+  // Open output file
+  // -----------------------------
+  if (to_mem)
+  {
+    if (avio_open_dyn_buf(&out_fmt->pb) < 0)
+    {
+      rc = SPLIT_ERR_NOMEM;
+      goto cleanup;
+    }
+    out_fmt->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+  else if (pack)
+  {
+    if (chunkpack_begin_chunk(pack, &out_fmt->pb) != PACK_OK)
+    {
+      rc = SPLIT_ERR_OUTPUT;
+      goto cleanup;
+    }
+    out_fmt->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+  else if (!(out_fmt->oformat->flags & AVFMT_NOFILE))
+  {
+    if (avio_open(&out_fmt->pb, output_file, AVIO_FLAG_WRITE) < 0)
+    {
+      rc = SPLIT_ERR_OUTPUT;
+      goto cleanup;
+    }
+  }
+
+  if (avformat_write_header(out_fmt, &mux_opts) < 0)
+  {
+    rc = SPLIT_ERR_WRITE;
+    goto cleanup;
+  }
+
+  // -----------------------------
+  // Copy packets
+  // -----------------------------
+  // Store objects start at zero whichever delivery wrote them
+  const double shift = digest && start_pts > 0.0 ? -start_pts : 0.0;
+  if (tl)
+    rc = copy_timeline(tl, in_fmt, opened, out_fmt, stream_map, start_pts, chunk->end);
+  else
+    rc = copy_range(in_fmt, out_fmt, stream_map, start_pts, chunk->end, shift,
+                    chunk_lead_in(chunk, cfg), digest);
+
+  av_write_trailer(out_fmt);
+
+cleanup:
+  if (to_mem && out_fmt && out_fmt->pb)
+  {
+    uint8_t *buf = NULL;
+    int size = avio_close_dyn_buf(out_fmt->pb, &buf);
+    out_fmt->pb = NULL;
+    if (rc == SPLIT_OK)
+    {
+      sink->mem = buf;
+      sink->mem_size = size;
+    }
+    else
+      av_free(buf);
+  }
+  else if (pack && out_fmt && out_fmt->pb)
+  {
+    if (rc == SPLIT_OK)
+    {
+      if (chunkpack_end_chunk(pack, chunk->index, &out_fmt->pb) != PACK_OK)
+        rc = SPLIT_ERR_WRITE;
+    }
+    else
+      chunkpack_abort_chunk(pack, &out_fmt->pb);
+  }
+  else if (out_fmt && !(out_fmt->oformat->flags & AVFMT_NOFILE))
+    avio_closep(&out_fmt->pb);
+
+  if (out_fmt)
+    avformat_free_context(out_fmt);
+
+  if (in_fmt)
+    avformat_close_input(&in_fmt);
+
+  free(stream_map);
+  av_dict_free(&mux_opts);
+
+  return rc;
+}
+
+int split_one_chunk(const char *input,
+                    const sc_chunk *chunk,
+                    const char *output_file,
+                    const split_output_mode *mode)
+{
+  return split_chunk_to(input, chunk, output_file, mode, NULL);
+}
+
+// ---------------------------------------------------------
+// CMAF chunk output: the fMP4 muxed for each chunk is cut
+// into its init part (ftyp+moov), shared by every chunk with
+// the same stream layout, and its media part (moof+mdat)
+// ---------------------------------------------------------
+static uint64_t rb_box(const uint8_t *p, int n)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < n; i++)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+static int cmaf_cut(const uint8_t *buf, int size, int *media_off, int *media_end)
+{
+  int64_t pos = 0;
+  *media_off = -1;
+  *media_end = size;
+
+  while (pos + 8 <= size)
+  {
+    int64_t len = (int64_t)rb_box(buf + pos, 4);
+    const uint8_t *type = buf + pos + 4;
+    if (len == 1 && pos + 16 <= size)
+      len = (int64_t)rb_box(buf + pos + 8, 8);
+    else if (len == 0)
+      len = size - pos;
+    if (len < 8 || pos + len > size)
+      return SPLIT_ERR_WRITE;
+
+    if (!memcmp(type, "mfra", 4))
+    {
+      *media_end = (int)pos;
+      break;
+    }
+    if (*media_off < 0 && memcmp(type, "ftyp", 4) && memcmp(type, "moov", 4))
+      *media_off = (int)pos;
+    pos += len;
+  }
+
+  return *media_off > 0 ? SPLIT_OK : SPLIT_ERR_WRITE;
+}
+
+static int write_bytes(const char *path, const uint8_t *buf, size_t len)
+{
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return SPLIT_ERR_OUTPUT;
+  int rc = fwrite(buf, 1, len, f) == len ? SPLIT_OK : SPLIT_ERR_WRITE;
+  if (fclose(f) != 0)
+    rc = SPLIT_ERR_WRITE;
+  return rc;
+}
+
+static uint64_t layout_hash(const uint8_t *buf, int len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < len; i++)
+  {
+    h ^= buf[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// Writes init.mp4 (init_N.mp4 for further layouts), chunk_NNNN.m4s and
+// chunks.m3u8, whose EXT-X-MAP tags say which init each chunk needs
+static int split_all_cmaf(const char *input,
+                          const sc_chunk_plan *plan,
+                          const char *outdir,
+                          const split_output_mode *mode)
+{
+  char path[512];
+  double max_dur = 1.0;
+  for (int i = 0; i < plan->count; i++)
+    max_dur = fmax(max_dur, plan->chunks[i].end - plan->chunks[i].start);
+
+  snprintf(path, sizeof(path), "%s/chunks.m3u8", outdir);
+  FILE *m3u8 = fopen(path, "w");
+  if (!m3u8)
+    return SPLIT_ERR_OUTPUT;
+
+  fprintf(m3u8, "#EXTM3U\n#EXT-X-VERSION:7\n#EXT-X-TARGETDURATION:%d\n"
+                "#EXT-X-PLAYLIST-TYPE:VOD\n#EXT-X-INDEPENDENT-SEGMENTS\n",
+          (int)ceil(max_dur));
+
+  uint64_t *layouts = NULL;
+  int layout_count = 0;
+  int current = -1;
+  int rc = SPLIT_OK;
+
+  for (int i = 0; i < plan->count && rc == SPLIT_OK; i++)
+  {
+    const sc_chunk *c = &plan->chunks[i];
+    split_sink sink = {.pack = NULL, .to_mem = 1, .mem = NULL, .mem_size = 0};
+
+    snprintf(path, sizeof(path), "%s/chunk_%04d.m4s", outdir, c->index);
+    fprintf(stderr, "[split] %s (%.3f → %.3f)\n", path, c->start, c->end);
+
+    rc = split_chunk_to(input, c, path, mode, &sink);
+    if (rc != SPLIT_OK)
+    {
+      fprintf(stderr, "split_one_chunk failed: %d\n", rc);
+      break;
+    }
+
+    int media_off = 0, media_end = 0;
+    rc = cmaf_cut(sink.mem, sink.mem_size, &media_off, &media_end);
+
+    // Identical ftyp+moov bytes mean the same stream layout
+    int layout = -1;
+    uint64_t h = layout_hash(sink.mem, media_off > 0 ? media_off : 0);
+    for (int l = 0; rc == SPLIT_OK && l < layout_count; l++)
+      if (layouts[l] == h)
+        layout = l;
+
+    char init_name[32];
+    const int is_new = layout < 0;
+    if (rc == SPLIT_OK && is_new)
+    {
+      uint64_t *grown = realloc(layouts, (layout_count + 1) * sizeof(*grown));
+      if (!grown)
+        rc = SPLIT_ERR_NOMEM;
+      else
+      {
+        layouts = grown;
+        layout = layout_count;
+        layouts[layout_count++] = h;
+      }
+    }
+
+    if (rc == SPLIT_OK)
+    {
+      if (layout == 0)
+        snprintf(init_name, sizeof(init_name), "init.mp4");
+      else
+        snprintf(init_name, sizeof(init_name), "init_%d.mp4", layout);
+
+      if (is_new)
+      {
+        char init_path[512];
+        snprintf(init_path, sizeof(init_path), "%s/%s", outdir, init_name);
+        rc = write_bytes(init_path, sink.mem, (size_t)media_off);
+      }
+    }
+
+    if (rc == SPLIT_OK)
+      rc = write_bytes(path, sink.mem + media_off, (size_t)(media_end - media_off));
+
+    if (rc == SPLIT_OK)
+    {
+      if (layout != current)
+        fprintf(m3u8, "#EXT-X-MAP:URI=\"%s\"\n", init_name);
+      fprintf(m3u8, "#EXTINF:%.6f,\nchunk_%04d.m4s\n", c->end - c->start, c->index);
+      current = layout;
+    }
+
+    av_free(sink.mem);
+  }
+
+  fprintf(m3u8, "#EXT-X-ENDLIST\n");
+  if (fclose(m3u8) != 0 && rc == SPLIT_OK)
+    rc = SPLIT_ERR_WRITE;
+  free(layouts);
+  return rc;
+}
+
+// <store>/<k0k1>/<key>.<ext>, creating the fan-out directory
+static int store_object_path(const char *store_dir, const char *key, const char *ext,
+                             char *path, size_t len)
+{
+  snprintf(path, len, "%s/%.2s", store_dir, key);
+  if (!mkdir_if_needed(store_dir) || !mkdir_if_needed(path))
+    return SPLIT_ERR_OUTPUT;
+  if (snprintf(path, len, "%s/%.2s/%s%s", store_dir, key, key, ext) >= (int)len)
+    return SPLIT_ERR_OUTPUT;
+  return SPLIT_OK;
+}
+
+// <chunk>.tags: the plan tags of a chunk whose file is shared
+// with the store, one key=value per line
+static int write_tag_sidecar(const char *chunk_path, const AVDictionary *tags)
+{
+  char path[1024];
+  if (snprintf(path, sizeof(path), "%s%s", chunk_path, SPLIT_TAGS_SUFFIX) >= (int)sizeof(path))
+    return SPLIT_ERR_OUTPUT;
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return SPLIT_ERR_OUTPUT;
+  const AVDictionaryEntry *t = NULL;
+  while ((t = av_dict_get(tags, "", t, AV_DICT_IGNORE_SUFFIX)))
+    fprintf(f, "%s=%s\n", t->key, t->value);
+  return fclose(f) == 0 ? SPLIT_OK : SPLIT_ERR_WRITE;
+}
+
+// Split one chunk through the store. The chunk is written untagged
+// with timestamps from zero, hashed while it is copied; when the store
+// already holds that key the copy is swapped for a link to the stored
+// object, otherwise it is added. Either way the plan tags go to the
+// sidecar. Stores on another filesystem cannot be hard-linked; those
+// chunks just stay written.
+static int split_chunk_stored(const char *input,
+                              const sc_chunk *chunk,
+                              const char *outpath,
+                              const split_output_mode *cfg,
+                              split_store_entry *e)
+{
+  split_digest digest;
+  memset(&digest, 0, sizeof(digest));
+  split_sink sink = {.pack = NULL, .to_mem = 0, .digest = &digest, .tags = NULL};
+  char obj[1024];
+  char tmp[1024];
+  const char *ext = strrchr(outpath, '.');
+
+  // outpath may still be a link into the store from an earlier run;
+  // writing through it would rewrite the stored object
+  unlink(outpath);
+  int rc = split_chunk_to(input, chunk, outpath, cfg, &sink);
+  if (rc == SPLIT_OK)
+  {
+    sha_hex(digest.all, e->key);
+    sha_hex(digest.video, e->video_key);
+    rc = store_object_path(cfg->store_dir, e->key, ext ? ext : "", obj, sizeof(obj));
+  }
+  if (rc == SPLIT_OK)
+    rc = write_tag_sidecar(outpath, sink.tags);
+
+  e->hit = 0;
+  if (rc == SPLIT_OK && access(obj, R_OK) == 0)
+  {
+    // Link beside the chunk, then rename over it: never left without one
+    snprintf(tmp, sizeof(tmp), "%s.link", outpath);
+    unlink(tmp);
+    if (link(obj, tmp) == 0 && rename(tmp, outpath) == 0)
+      e->hit = 1;
+    else
+      unlink(tmp);
+  }
+  else if (rc == SPLIT_OK && link(outpath, obj) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "[store] cannot add %s: %s\n", obj, strerror(errno));
+  }
+
+  digest_free(&digest);
+  av_dict_free(&sink.tags);
+  return rc;
+}
+
+// ---------------------------------------------------------
+// Split all chunks (single-threaded version)
+// (Threaded version exists in chunkify_cli)
+// ---------------------------------------------------------
+int split_all_chunks(const char *input,
+                     const sc_chunk_plan *plan,
+                     const char *outdir,
+                     const split_output_mode *mode)
+{
+  if (!plan || plan->count <= 0)
+    return SPLIT_OK;
+
+  if (!mkdir_if_needed(outdir))
+  {
+    fprintf(stderr, "mkdir failed: %s\n", outdir);
+    return SPLIT_ERR_OUTPUT;
+  }
+
+  char outpath[512];
+
+  // Every chunk carries its place in the plan
+  split_output_mode tagged = {
+      .auto_mode = 1,
+      .force_fmt = NULL,
+      .output_frag = 0};
+  if (mode)
+    tagged = *mode;
+  tagged.chunk_count = plan->count;
+  tagged.plan_hash = sc_plan_hash(plan);
+
+  // The store links whole chunk files, hashed from a single input
+  if (tagged.store_dir && (tagged.pack_output || tagged.cmaf_output || tagged.timeline))
+    return SPLIT_ERR_INVAL;
+
+  // Media-only chunks have no moov of their own to carry tags
+  if (tagged.cmaf_output)
+  {
+    if (tagged.pack_output)
+      return SPLIT_ERR_INVAL;
+    tagged.chunk_count = 0;
+    return split_all_cmaf(input, plan, outdir, &tagged);
+  }
+
+  // Pack mode: one append-only file instead of one file per chunk
+  chunkpack pack;
+  split_sink sink = {.pack = NULL, .to_mem = 0, .mem = NULL, .mem_size = 0};
+  split_sink *sinkp = NULL;
+  chunkpack *packp = NULL;
+  if (tagged.pack_output)
+  {
+    snprintf(outpath, sizeof(outpath), "%s/%s", outdir, CHUNKPACK_NAME);
+    if (chunkpack_create(outpath, &pack) != PACK_OK)
+    {
+      fprintf(stderr, "cannot create pack: %s\n", outpath);
+      return SPLIT_ERR_OUTPUT;
+    }
+    packp = &pack;
+    sink.pack = packp;
+    sinkp = &sink;
+  }
+
+  int rc = SPLIT_OK;
+  for (int i = 0; i < plan->count; i++)
+  {
+    const sc_chunk *c = &plan->chunks[i];
+
+    snprintf(outpath, sizeof(outpath),
+             "%s/chunk_%04d.mp4", outdir, c->index);
+
+    if (tagged.store_dir)
+    {
+      split_store_entry local;
+      split_store_entry *e = tagged.store_entries ? &tagged.store_entries[i] : &local;
+      rc = split_chunk_stored(input, c, outpath, &tagged, e);
+      if (rc != SPLIT_OK)
+      {
+        fprintf(stderr, "split_one_chunk failed: %d\n", rc);
+        break;
+      }
+      fprintf(stderr, "[split] %s (%.3f → %.3f) [store %s %.12s]\n",
+              outpath, c->start, c->end, e->hit ? "hit" : "miss", e->key);
+      continue;
+    }
+
+    fprintf(stderr, "[split] %s%s (%.3f → %.3f)\n",
+            outpath, packp ? " [pack]" : "", c->start, c->end);
+
+    rc = split_chunk_to(input, c, outpath, &tagged, sinkp);
+    if (rc != SPLIT_OK)
+    {
+      fprintf(stderr, "split_one_chunk failed: %d\n", rc);
+      break;
+    }
+  }
+
+  if (packp && chunkpack_close(packp) != PACK_OK && rc == SPLIT_OK)
+    rc = SPLIT_ERR_WRITE;
+  return rc;
+}
+
+// ---------------------------------------------------------
+// Fused probe + plan + split: one demux pass feeds the online
+// planner and the chunk muxers together. Packets that might
+// fall on either side of the next cut wait in a queue until
+// the planner commits to it.
+// ---------------------------------------------------------
+typedef struct
+{
+  AVFormatContext *in_fmt;
+  const char *input;
+  const char *outdir;
+  const split_output_mode *cfg;
+  double min_dur;
+
+  AVFormatContext *out_fmt; // chunk being written
+  int *stream_map;
+  int index;
+  double start;
+  double safe_end;   // start + min_dur: no cut can land before it
+  int video_held;    // a keyframe past safe_end arrived; queue video
+  int keyframe_seen; // video before the first keyframe is dropped
+
+  AVPacket **queue;
+  int queue_count;
+  int queue_capacity;
+} fused_split;
+
+static double fused_ts(const fused_split *fs, const AVPacket *pkt)
+{
+  AVRational tb = fs->in_fmt->streams[pkt->stream_index]->time_base;
+  if (pkt->pts != AV_NOPTS_VALUE)
+    return pkt->pts * av_q2d(tb);
+  if (pkt->dts != AV_NOPTS_VALUE)
+    return pkt->dts * av_q2d(tb);
+  return 0.0;
+}
+
+static int fused_open(fused_split *fs)
+{
+  char outpath[512];
+  snprintf(outpath, sizeof(outpath), "%s/chunk_%04d.mp4", fs->outdir, fs->index);
+
+  const char *fmt_name = chunk_output_fmt(fs->input, fs->cfg);
+  const AVOutputFormat *ofmt = av_guess_format(fmt_name, NULL, NULL);
+  if (!ofmt)
+    return SPLIT_ERR_OUTPUT;
+
+  if (avformat_alloc_output_context2(&fs->out_fmt, ofmt, fmt_name, outpath) < 0)
+    return SPLIT_ERR_OUTPUT;
+
+  int rc = map_output_streams(fs->in_fmt, fs->out_fmt, fs->stream_map);
+  if (rc != SPLIT_OK)
+    return rc;
+
+  if (!(fs->out_fmt->oformat->flags & AVFMT_NOFILE) &&
+      avio_open(&fs->out_fmt->pb, outpath, AVIO_FLAG_WRITE) < 0)
+    return SPLIT_ERR_OUTPUT;
+
+  AVDictionary *mux_opts = NULL;
+  if (fs->cfg->output_frag && !strcmp(fmt_name, "mp4"))
+    av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+omit_tfhd_offset", 0);
+
+  int wr = avformat_write_header(fs->out_fmt, &mux_opts);
+  av_dict_free(&mux_opts);
+  if (wr < 0)
+    return SPLIT_ERR_WRITE;
+
+  fs->video_held = 0;
+  fs->safe_end = fs->start + fs->min_dur;
+  return SPLIT_OK;
+}
+
+static void fused_close(fused_split *fs, int ok)
+{
+  if (!fs->out_fmt)
+    return;
+  if (ok)
+    av_write_trailer(fs->out_fmt);
+  if (!(fs->out_fmt->oformat->flags & AVFMT_NOFILE))
+    avio_closep(&fs->out_fmt->pb);
+  avformat_free_context(fs->out_fmt);
+  fs->out_fmt = NULL;
+}
+
+// Write an owned packet to the open chunk and free it
+static int fused_write(fused_split *fs, AVPacket *pkt)
+{
+  AVStream *ist = fs->in_fmt->streams[pkt->stream_index];
+  int out_si = fs->stream_map[pkt->stream_index];
+  AVStream *ost = fs->out_fmt->streams[out_si];
+
+  // Timestamps stay on the source timeline, as in split_one_chunk
+  av_packet_rescale_ts(pkt, ist->time_base, ost->time_base);
+  pkt->pos = -1;
+  pkt->stream_index = out_si;
+
+  int wr = av_interleaved_write_frame(fs->out_fmt, pkt);
+  av_packet_free(&pkt);
+  return wr < 0 ? SPLIT_ERR_WRITE : SPLIT_OK;
+}
+
+// Write an owned packet now if the chunk surely contains it,
+// otherwise park it until the cut is known
+static int fused_route(fused_split *fs, AVPacket *pkt)
+{
+  AVStream *ist = fs->in_fmt->streams[pkt->stream_index];
+  if (fs->stream_map[pkt->stream_index] < 0)
+  {
+    av_packet_free(&pkt);
+    return SPLIT_OK;
+  }
+
+  double ts = fused_ts(fs, pkt);
+  int is_key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+  int hold;
+
+  if (ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+  {
+    if (!fs->keyframe_seen)
+    {
+      if (!is_key)
+      {
+        av_packet_free(&pkt);
+        return SPLIT_OK;
+      }
+      fs->keyframe_seen = 1;
+    }
+    if (is_key && ts > fs->start + 1e-6 && ts >= fs->safe_end - 1e-6)
+      fs->video_held = 1;
+    hold = fs->video_held;
+  }
+  else
+  {
+    hold = ts >= fs->safe_end;
+  }
+
+  if (!hold)
+    return fused_write(fs, pkt);
+
+  if (fs->queue_count == fs->queue_capacity)
+  {
+    int newcap = fs->queue_capacity ? fs->queue_capacity * 2 : 256;
+    AVPacket **q = realloc(fs->queue, newcap * sizeof(*q));
+    if (!q)
+    {
+      av_packet_free(&pkt);
+      return SPLIT_ERR_NOMEM;
+    }
+    fs->queue = q;
+    fs->queue_capacity = newcap;
+  }
+  fs->queue[fs->queue_count++] = pkt;
+  return SPLIT_OK;
+}
+
+// The planner committed to `chunk`: flush what belongs to it, close
+// it, and (unless it was the last one) start the next chunk with the
+// rest of the queue
+static int fused_cut(fused_split *fs, const sc_chunk *chunk, int last)
+{
+  double cut = chunk->end;
+  int rc = SPLIT_OK;
+  int video_done = 0;
+  int keep = 0;
+
+  for (int i = 0; i < fs->queue_count; i++)
+  {
+    AVPacket *pkt = fs->queue[i];
+    AVStream *ist = fs->in_fmt->streams[pkt->stream_index];
+    double ts = fused_ts(fs, pkt);
+    int mine;
+
+    if (last)
+      mine = 1;
+    else if (ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+    {
+      if ((pkt->flags & AV_PKT_FLAG_KEY) && ts >= cut - 1e-6)
+        video_done = 1;
+      mine = !video_done;
+    }
+    else
+      mine = ts < cut;
+
+    if (!mine)
+    {
+      fs->queue[keep++] = pkt;
+      continue;
+    }
+
+    fs->queue[i] = NULL;
+    if (rc == SPLIT_OK)
+      rc = fused_write(fs, pkt);
+    else
+      av_packet_free(&pkt);
+  }
+  fs->queue_count = keep;
+
+  fused_close(fs, rc == SPLIT_OK);
+  if (rc != SPLIT_OK)
+    return rc;
+
+  fprintf(stderr, "[split] %s/chunk_%04d.mp4 (%.3f → %.3f) [fused]\n",
+          fs->outdir, chunk->index, chunk->start, chunk->end);
+
+  if (last)
+    return SPLIT_OK;
+
+  fs->index++;
+  fs->start = cut;
+  rc = fused_open(fs);
+  if (rc != SPLIT_OK)
+    return rc;
+
+  // Re-route the leftovers against the new chunk's window
+  AVPacket **rest = fs->queue;
+  int rest_count = fs->queue_count;
+  fs->queue = NULL;
+  fs->queue_count = fs->queue_capacity = 0;
+
+  for (int i = 0; i < rest_count; i++)
+  {
+    if (rc == SPLIT_OK)
+      rc = fused_route(fs, rest[i]);
+    else
+      av_packet_free(&rest[i]);
+  }
+  free(rest);
+  return rc;
+}
+
+static int fused_append(sc_chunk_plan *plan, const sc_chunk *chunk)
+{
+  if (plan->count == plan->capacity)
+  {
+    int newcap = plan->capacity ? plan->capacity * 2 : 64;
+    sc_chunk *chunks = realloc(plan->chunks, newcap * sizeof(*chunks));
+    if (!chunks)
+      return SPLIT_ERR_NOMEM;
+    plan->chunks = chunks;
+    plan->capacity = newcap;
+  }
+  plan->chunks[plan->count++] = *chunk;
+  return SPLIT_OK;
+}
+
+int split_fused(const char *input,
+                const split_input_mode *in,
+                sc_plan_config pcfg,
+                const char *outdir,
+                const split_output_mode *mode,
+                sc_chunk_plan *plan_out)
+{
+  if (!input || !outdir || !plan_out)
+    return SPLIT_ERR_INVAL;
+
+  memset(plan_out, 0, sizeof(*plan_out));
+
+  // The chunk count is unknown until the end, so there is nothing to
+  // tag with and nothing to pack/CMAF-index ahead of time
+  const split_output_mode default_mode = {.auto_mode = 1};
+  const split_output_mode *cfg = mode ? mode : &default_mode;
+  if (cfg->pack_output || cfg->cmaf_output)
+    return SPLIT_ERR_INVAL;
+
+  if (!mkdir_if_needed(outdir))
+  {
+    fprintf(stderr, "mkdir failed: %s\n", outdir);
+    return SPLIT_ERR_OUTPUT;
+  }
+
+  int rc = SPLIT_OK;
+  sc_online_planner *planner = NULL;
+  AVPacket *pkt = NULL;
+  fused_split fs;
+  memset(&fs, 0, sizeof(fs));
+  fs.input = input;
+  fs.outdir = outdir;
+  fs.cfg = cfg;
+
+  const int follow = in && in->follow;
+  if (follow)
+  {
+    if (followio_open(input, in->idle_timeout, &fs.in_fmt) != FOLLOW_OK)
+      return SPLIT_ERR_OPEN;
+  }
+  else if (avformat_open_input(&fs.in_fmt, input, NULL, NULL) < 0)
+    return SPLIT_ERR_OPEN;
+
+  if (avformat_find_stream_info(fs.in_fmt, NULL) < 0)
+  {
+    rc = SPLIT_ERR_FFMPEG;
+    goto cleanup;
+  }
+
+  int video_index = av_find_best_stream(fs.in_fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (video_index < 0)
+  {
+    rc = SPLIT_ERR_STREAM;
+    goto cleanup;
+  }
+
+  // A growing recording's header duration is only what existed at open
+  double hint = 0.0;
+  if (!follow && fs.in_fmt->duration > 0)
+    hint = fs.in_fmt->duration / (double)AV_TIME_BASE;
+
+  if (sc_online_create(pcfg, hint, &planner) != SC_OK)
+  {
+    rc = SPLIT_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  // Same defaults as the planner, so the safe window matches its cuts
+  double target = pcfg.target_dur;
+  if (pcfg.ideal_parallel > 0 && hint > 0.0)
+    target = hint / pcfg.ideal_parallel;
+  if (target <= 0.0)
+    target = 10.0;
+  fs.min_dur = pcfg.min_dur > 0.0 ? pcfg.min_dur : target * 0.5;
+
+  fs.stream_map = calloc(fs.in_fmt->nb_streams, sizeof(int));
+  pkt = av_packet_alloc();
+  if (!fs.stream_map || !pkt)
+  {
+    rc = SPLIT_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  rc = fused_open(&fs);
+  if (rc != SPLIT_OK)
+    goto cleanup;
+
+  double best_end = 0.0;
+  sc_chunk c;
+
+  while (rc == SPLIT_OK && av_read_frame(fs.in_fmt, pkt) >= 0)
+  {
+    if (pkt->stream_index == video_index)
+    {
+      AVRational tb = fs.in_fmt->streams[video_index]->time_base;
+      double ts = fused_ts(&fs, pkt);
+      double end = pkt->duration > 0 ? ts + pkt->duration * av_q2d(tb) : ts;
+      if (end > best_end)
+        best_end = end;
+
+      sc_frame_meta meta = {
+          .pts_time = ts,
+          .is_keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0,
+          .pkt_size = pkt->size,
+          .pict_type = 0,
+          .complexity = 0.0,
+          .is_scene_cut = 0};
+      if (sc_online_push(planner, &meta) != SC_OK)
+      {
+        av_packet_unref(pkt);
+        rc = SPLIT_ERR_NOMEM;
+        break;
+      }
+    }
+
+    AVPacket *own = av_packet_alloc();
+    if (!own)
+    {
+      av_packet_unref(pkt);
+      rc = SPLIT_ERR_NOMEM;
+      break;
+    }
+    av_packet_move_ref(own, pkt);
+    rc = fused_route(&fs, own);
+
+    while (rc == SPLIT_OK && sc_online_next(planner, &c))
+    {
+      rc = fused_append(plan_out, &c);
+      if (rc == SPLIT_OK)
+        rc = fused_cut(&fs, &c, 0);
+    }
+  }
+
+  if (rc != SPLIT_OK)
+    goto cleanup;
+
+  if (best_end <= 0.0)
+    best_end = hint;
+  if (sc_online_finish(planner, best_end) != SC_OK)
+  {
+    rc = SPLIT_ERR_INVAL;
+    goto cleanup;
+  }
+
+  while (rc == SPLIT_OK && sc_online_next(planner, &c))
+  {
+    rc = fused_append(plan_out, &c);
+    if (rc == SPLIT_OK)
+      rc = fused_cut(&fs, &c, c.end >= best_end - 1e-6);
+  }
+
+cleanup:
+  fused_close(&fs, 0);
+  for (int i = 0; i < fs.queue_count; i++)
+    av_packet_free(&fs.queue[i]);
+  free(fs.queue);
+  free(fs.stream_map);
+  if (pkt)
+    av_packet_free(&pkt);
+  sc_online_free(&planner);
+  if (follow)
+    followio_close(&fs.in_fmt);
+  else if (fs.in_fmt)
+    avformat_close_input(&fs.in_fmt);
+  if (rc != SPLIT_OK)
+    sc_free_chunk_plan(plan_out);
+  return rc;
+}
+
+// ---------------------------------------------------------
+// EDL extraction: every range of a sc_plan_ranges plan in
+// one forward pass over the input. Short gaps are read
+// through; longer ones are skipped with a forward seek.
+// ---------------------------------------------------------
+#define RANGE_SEEK_GAP 10.0
+
+typedef struct
+{
+  AVFormatContext *in_fmt;
+  AVFormatContext *out_fmt;
+  const char *fmt_name;
+  int *stream_map;
+  int64_t *last_dts; /* per output stream, output time base */
+} range_split;
+
+static int range_open(range_split *rs, const char *path)
+{
+  if (avformat_alloc_output_context2(&rs->out_fmt, NULL, rs->fmt_name, path) < 0)
+    return SPLIT_ERR_OUTPUT;
+
+  int rc = map_output_streams(rs->in_fmt, rs->out_fmt, rs->stream_map);
+  if (rc != SPLIT_OK)
+    return rc;
+
+  if (!(rs->out_fmt->oformat->flags & AVFMT_NOFILE) &&
+      avio_open(&rs->out_fmt->pb, path, AVIO_FLAG_WRITE) < 0)
+    return SPLIT_ERR_OUTPUT;
+
+  if (avformat_write_header(rs->out_fmt, NULL) < 0)
+    return SPLIT_ERR_WRITE;
+
+  for (unsigned i = 0; i < rs->in_fmt->nb_streams; i++)
+    rs->last_dts[i] = AV_NOPTS_VALUE;
+  return SPLIT_OK;
+}
+
+static void range_close(range_split *rs, int ok)
+{
+  if (!rs->out_fmt)
+    return;
+  if (ok)
+    av_write_trailer(rs->out_fmt);
+  if (!(rs->out_fmt->oformat->flags & AVFMT_NOFILE))
+    avio_closep(&rs->out_fmt->pb);
+  avformat_free_context(rs->out_fmt);
+  rs->out_fmt = NULL;
+}
+
+static int range_open_index(range_split *rs, const char *outdir, int index)
+{
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/range_%04d.mp4", outdir, index);
+  fprintf(stderr, "[split] %s\n", path);
+  return range_open(rs, path);
+}
+
+int split_ranges(const char *input,
+                 const sc_chunk_plan *ranges,
+                 const char *outdir,
+                 const char *concat_out,
+                 const split_output_mode *mode)
+{
+  if (!input || !ranges || ranges->count <= 0 || !outdir == !concat_out)
+    return SPLIT_ERR_INVAL;
+
+  if (outdir && !mkdir_if_needed(outdir))
+  {
+    fprintf(stderr, "mkdir failed: %s\n", outdir);
+    return SPLIT_ERR_OUTPUT;
+  }
+
+  const split_output_mode default_mode = {.auto_mode = 1};
+  const split_output_mode *cfg = mode ? mode : &default_mode;
+
+  int rc = SPLIT_OK;
+  range_split rs;
+  memset(&rs, 0, sizeof(rs));
+  AVPacket *pkt = NULL;
+  int *ended = NULL;
+
+  if (avformat_open_input(&rs.in_fmt, input, NULL, NULL) < 0)
+    return SPLIT_ERR_OPEN;
+  if (avformat_find_stream_info(rs.in_fmt, NULL) < 0)
+  {
+    rc = SPLIT_ERR_FFMPEG;
+    goto cleanup;
+  }
+
+  const unsigned n = rs.in_fmt->nb_streams;
+  rs.stream_map = calloc(n, sizeof(int));
+  rs.last_dts = calloc(n, sizeof(int64_t));
+  ended = calloc(n, sizeof(int));
+  pkt = av_packet_alloc();
+  if (!rs.stream_map || !rs.last_dts || !ended || !pkt)
+  {
+    rc = SPLIT_ERR_NOMEM;
+    goto cleanup;
+  }
+
+  // A concatenated output is muxed as its own extension says
+  rs.fmt_name = chunk_output_fmt(concat_out ? concat_out : input, cfg);
+  rc = concat_out ? range_open(&rs, concat_out) : range_open_index(&rs, outdir, 0);
+  if (rc != SPLIT_OK)
+    goto cleanup;
+
+  if (av_seek_frame(rs.in_fmt, -1, (int64_t)(ranges->chunks[0].start * AV_TIME_BASE),
+                    AVSEEK_FLAG_BACKWARD) < 0)
+  {
+    rc = SPLIT_ERR_SEEK;
+    goto cleanup;
+  }
+
+  // Output time of the current range's start: 0 for separate files,
+  // the running total of earlier ranges when concatenated
+  double base = 0.0;
+  int cur = 0;
+  int first_keyframe_found = 0;
+
+  while (cur < ranges->count && rc == SPLIT_OK && av_read_frame(rs.in_fmt, pkt) >= 0)
+  {
+    AVStream *ist = rs.in_fmt->streams[pkt->stream_index];
+    int in_si = pkt->stream_index;
+    int out_si = rs.stream_map[in_si];
+    if (out_si < 0)
+    {
+      av_packet_unref(pkt);
+      continue;
+    }
+
+    double ts = 0.0;
+    if (pkt->pts != AV_NOPTS_VALUE)
+      ts = pkt->pts * av_q2d(ist->time_base);
+    else if (pkt->dts != AV_NOPTS_VALUE)
+      ts = pkt->dts * av_q2d(ist->time_base);
+    const int is_video = ist->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+    const int is_key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+
+    // Same selection as copy_range, per range; a packet past one range
+    // is looked at again for the next
+    while (cur < ranges->count)
+    {
+      const sc_chunk *c = &ranges->chunks[cur];
+
+      if (!first_keyframe_found)
+      {
+        if (is_video && (!is_key || ts < c->start))
+          break;
+        if (!is_video && ts < c->start)
+          break;
+        if (is_video)
+          first_keyframe_found = 1;
+      }
+
+      // Each stream runs to its own end: video to a keyframe at or
+      // after c->end, the others to the first packet there
+      int past = ended[in_si];
+      if (!past && ts >= c->end && (!is_video || is_key))
+      {
+        ended[in_si] = 1;
+        past = 1;
+      }
+
+      if (!past)
+      {
+        AVStream *ost = rs.out_fmt->streams[out_si];
+        int64_t d = av_rescale_q(llrint((base - c->start) * AV_TIME_BASE), AV_TIME_BASE_Q,
+                                 ist->time_base);
+        if (pkt->pts != AV_NOPTS_VALUE)
+          pkt->pts += d;
+        if (pkt->dts != AV_NOPTS_VALUE)
+          pkt->dts += d;
+        av_packet_rescale_ts(pkt, ist->time_base, ost->time_base);
+
+        // Ranges are not contiguous in the source; keep dts increasing
+        // across a join
+        if (pkt->dts != AV_NOPTS_VALUE)
+        {
+          if (rs.last_dts[out_si] != AV_NOPTS_VALUE && pkt->dts <= rs.last_dts[out_si])
+            pkt->dts = rs.last_dts[out_si] + 1;
+          if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+            pkt->pts = pkt->dts;
+          rs.last_dts[out_si] = pkt->dts;
+        }
+
+        pkt->pos = -1;
+        pkt->stream_index = out_si;
+        if (av_interleaved_write_frame(rs.out_fmt, pkt) < 0)
+          rc = SPLIT_ERR_WRITE;
+        break;
+      }
+
+      // The range is complete once its video and audio have all ended
+      int all_ended = 1;
+      for (unsigned i = 0; i < n; i++)
+      {
+        enum AVMediaType type = rs.in_fmt->streams[i]->codecpar->codec_type;
+        if (rs.stream_map[i] >= 0 && !ended[i] &&
+            (type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO))
+        {
+          all_ended = 0;
+          break;
+        }
+      }
+      if (!all_ended)
+        break;
+
+      cur++;
+      first_keyframe_found = 0;
+      memset(ended, 0, n * sizeof(int));
+      if (concat_out)
+        base += c->end - c->start;
+      if (cur == ranges->count)
+        break;
+
+      if (outdir)
+      {
+        range_close(&rs, 1);
+        if ((rc = range_open_index(&rs, outdir, cur)) != SPLIT_OK)
+          break;
+      }
+
+      const double next = ranges->chunks[cur].start;
+      if (next - ts > RANGE_SEEK_GAP)
+      {
+        if (av_seek_frame(rs.in_fmt, -1, (int64_t)(next * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD) < 0)
+          rc = SPLIT_ERR_SEEK;
+        break;
+      }
+    }
+
+    av_packet_unref(pkt);
+  }
+
+cleanup:
+  range_close(&rs, rc == SPLIT_OK);
+  av_packet_free(&pkt);
+  if (rs.in_fmt)
+    avformat_close_input(&rs.in_fmt);
+  free(rs.stream_map);
+  free(rs.last_dts);
+  free(ended);
+  return rc;
+}
@@ -20,11 +20,48 @@ enum
     SPLIT_ERR_INVAL = -17
 };
 
+/* Container tags written into every chunk so the chunk directory is
+   self-describing (see stitch_scan_chunks) */
+#define SPLIT_TAG_INDEX "chunkify_index"
+#define SPLIT_TAG_COUNT "chunkify_count"
+#define SPLIT_TAG_START "chunkify_start"
+#define SPLIT_TAG_END "chunkify_end"
+#define SPLIT_TAG_PLAN "chunkify_plan"
+/* Audio pre-roll (sec) copied ahead of the chunk's start; absent = none.
+   The stitcher trims exactly this much */
+#define SPLIT_TAG_PREROLL "chunkify_preroll"
+/* Chunks shared with a content-addressed store are untagged; their tags
+   are kept beside them in <chunk><SPLIT_TAGS_SUFFIX>, one key=value per
+   line, which the stitcher reads for untagged chunks */
+#define SPLIT_TAGS_SUFFIX ".tags"
+
+/* Per-chunk outcome of a content-addressed split (store_dir set) */
+typedef struct
+{
+    char key[65];       /* SHA-256 of the mux settings and every copied
+                           packet: store object name */
+    char video_key[65]; /* SHA-256 of the video packets alone: encode cache key */
+    int hit;            /* chunk was already stored; the written copy was
+                           replaced by a link to the stored object */
+} split_store_entry;
+
 typedef struct
 {
     int auto_mode;         /* 1 = detect from input filename (default) */
     const char *force_fmt; /* optional muxer short name */
     int output_frag;       /* fragmented MP4 when >0 */
+    int chunk_count;       /* >0: tag chunks with index/count/range/plan */
+    uint64_t plan_hash;    /* sc_plan_hash() of the owning plan */
+    int pack_output;       /* split_all_chunks: append to <outdir>/chunks.pack */
+    int cmaf_output;       /* split_all_chunks: init.mp4 + media-only .m4s chunks */
+    const char *store_dir; /* split_all_chunks: content-addressed chunk store */
+    split_store_entry *store_entries; /* optional, plan->count results */
+    double audio_preroll;  /* audio-only input: seconds of the previous chunk
+                              copied ahead of each chunk (stitch trims it) */
+    const sc_timeline *timeline; /* input is this multi-file timeline (the
+                                    input argument only picks the muxer) */
+    double clip_from;      /* >0: the chunk starting here (sc_probe_range
+                              clip) takes video from the keyframe before */
 } split_output_mode;
 
 int split_one_chunk(const char *input,
@@ -37,6 +74,34 @@ int split_all_chunks(const char *input,
                      const char *outdir,
                      const split_output_mode *mode);
 
+/* EDL extraction: copy every range of an sc_plan_ranges plan in one
+   forward pass over input. With outdir, each range becomes
+   <outdir>/range_NNNN.mp4 starting at zero; with concat_out, the ranges
+   are joined back to back in that one file. Exactly one of the two. */
+int split_ranges(const char *input,
+                 const sc_chunk_plan *ranges,
+                 const char *outdir,
+                 const char *concat_out,
+                 const split_output_mode *mode);
+
+typedef struct
+{
+    int follow;          /* input is still being written (see followio.h) */
+    double idle_timeout; /* follow: seconds without growth that end it */
+} split_input_mode;
+
+/* Probe, plan and split in a single demux pass using the online planner
+   (sc_online_*). Chunks are written as chunk_NNNN.mp4 while the input is
+   read; the resulting plan is returned in plan_out. Chunks are untagged,
+   and pack/CMAF output is not available (the count is unknown up front).
+   With in->follow, chunks are emitted while a live recording grows. */
+int split_fused(const char *input,
+                const split_input_mode *in,
+                sc_plan_config pcfg,
+                const char *outdir,
+                const split_output_mode *mode,
+                sc_chunk_plan *plan_out);
+
 #ifdef __cplusplus
 }
 #endif
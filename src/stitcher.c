@@ -1,15 +1,23 @@
 #include "stitcher.h"
+#include "chunkpack.h"
+#include "splitter.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 
+#define STITCH_IO_BUFSIZE (64 * 1024)
+
 typedef struct
 {
   int out_index;
@@ -35,23 +43,288 @@ static const char *detect_fmt(const char *path)
     return "matroska";
   if (!strcasecmp(ext, "webm"))
     return "webm";
+  if (!strcasecmp(ext, "ts"))
+    return "mpegts";
+  if (!strcasecmp(ext, "m3u8"))
+    return "hls";
+  if (!strcasecmp(ext, "mpd"))
+    return "dash";
   return "mp4";
 }
 
-static int chunk_abs_path(char *dst, size_t sz,
-                          const char *dir,
-                          int index)
+int stitch_is_pipe_output(const char *url)
 {
-  char tmp[PATH_MAX];
-  if (snprintf(tmp, sizeof(tmp), "%s/chunk_%04d.mp4", dir, index) >= (int)sizeof(tmp))
-    return -1;
-  if (!realpath(tmp, dst))
+  return !strcmp(url, "-") || !strncmp(url, "pipe:", 5);
+}
+
+// ---------------------------------------------------------
+// Segmenting muxer options. Both muxers cut on video
+// keyframes once segment_dur has elapsed, so segments line
+// up with the chunk GOPs without a second pass.
+// ---------------------------------------------------------
+static const char *package_fmt(int package)
+{
+  switch (package)
+  {
+  case STITCH_PACKAGE_HLS:
+    return "hls";
+  case STITCH_PACKAGE_DASH:
+  case STITCH_PACKAGE_CMAF:
+    return "dash";
+  default:
+    return NULL;
+  }
+}
+
+static void set_package_opts(AVDictionary **opts,
+                             const char *fmt_name,
+                             int package,
+                             double segment_dur)
+{
+  char dur[32];
+  snprintf(dur, sizeof(dur), "%.3f", segment_dur > 0.0 ? segment_dur : 6.0);
+
+  if (!strcmp(fmt_name, "hls"))
+  {
+    av_dict_set(opts, "hls_segment_type", "fmp4", 0);
+    av_dict_set(opts, "hls_time", dur, 0);
+    av_dict_set(opts, "hls_playlist_type", "vod", 0);
+    av_dict_set(opts, "hls_flags", "independent_segments", 0);
+  }
+  else if (!strcmp(fmt_name, "dash"))
+  {
+    av_dict_set(opts, "seg_duration", dur, 0);
+    av_dict_set(opts, "dash_segment_type", "mp4", 0);
+    av_dict_set(opts, "use_template", "1", 0);
+    av_dict_set(opts, "use_timeline", "1", 0);
+    if (package == STITCH_PACKAGE_CMAF)
+      av_dict_set(opts, "hls_playlist", "1", 0);
+  }
+}
+
+// Raw demuxer for an elementary-stream chunk extension
+static const char *detect_es_fmt(const char *ext)
+{
+  if (!strcasecmp(ext, "264") || !strcasecmp(ext, "h264") || !strcasecmp(ext, "avc"))
+    return "h264";
+  if (!strcasecmp(ext, "265") || !strcasecmp(ext, "h265") || !strcasecmp(ext, "hevc"))
+    return "hevc";
+  if (!strcasecmp(ext, "ivf"))
+    return "ivf";
+  if (!strcasecmp(ext, "obu"))
+    return "obu";
+  return NULL;
+}
+
+static int chunk_file_path(char *dst, size_t sz,
+                           const char *dir,
+                           int index,
+                           const char *ext)
+{
+  if (snprintf(dst, sz, "%s/chunk_%04d.%s", dir, index, ext) >= (int)sz)
     return -1;
-  if (strlen(dst) >= sz)
+  return 0;
+}
+
+// ---------------------------------------------------------
+// Chunk tag scan
+// ---------------------------------------------------------
+typedef struct
+{
+  int index;
+  int count;
+  double start;
+  double end;
+  const char *plan;
+} chunk_tags;
+
+static int read_chunk_tags(AVFormatContext *ctx, chunk_tags *tags)
+{
+  const AVDictionaryEntry *e[5] = {
+      av_dict_get(ctx->metadata, SPLIT_TAG_INDEX, NULL, 0),
+      av_dict_get(ctx->metadata, SPLIT_TAG_COUNT, NULL, 0),
+      av_dict_get(ctx->metadata, SPLIT_TAG_START, NULL, 0),
+      av_dict_get(ctx->metadata, SPLIT_TAG_END, NULL, 0),
+      av_dict_get(ctx->metadata, SPLIT_TAG_PLAN, NULL, 0)};
+
+  for (int i = 0; i < 5; i++)
+    if (!e[i])
+      return -1;
+
+  tags->index = atoi(e[0]->value);
+  tags->count = atoi(e[1]->value);
+  tags->start = strtod(e[2]->value, NULL);
+  tags->end = strtod(e[3]->value, NULL);
+  tags->plan = e[4]->value;
+
+  if (tags->count <= 0 || tags->index < 0 || tags->index >= tags->count)
     return -1;
   return 0;
 }
 
+// A chunk shared with the store has its tags in a sidecar
+// (SPLIT_TAGS_SUFFIX); read only when the file itself is untagged
+static void merge_tag_sidecar(AVFormatContext *ctx, const char *chunk_path)
+{
+  if (av_dict_get(ctx->metadata, SPLIT_TAG_INDEX, NULL, 0))
+    return;
+
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s%s", chunk_path, SPLIT_TAGS_SUFFIX) >= (int)sizeof(path))
+    return;
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return;
+
+  char line[256];
+  while (fgets(line, sizeof(line), f))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *eq = strchr(line, '=');
+    if (!eq)
+      continue;
+    *eq = '\0';
+    av_dict_set(&ctx->metadata, line, eq + 1, 0);
+  }
+  fclose(f);
+}
+
+typedef struct
+{
+  sc_chunk_plan *plan;
+  char *seen;
+  char plan_id[32];
+} chunk_scan;
+
+// Record one tagged chunk; all chunks must agree on count and plan
+static int scan_add_chunk(chunk_scan *scan, AVFormatContext *ctx, int index)
+{
+  chunk_tags tags;
+  if (read_chunk_tags(ctx, &tags) != 0 || tags.index != index)
+    return STITCH_ERR_INPUT;
+
+  sc_chunk_plan *out = scan->plan;
+  if (!out->chunks)
+  {
+    snprintf(scan->plan_id, sizeof(scan->plan_id), "%s", tags.plan);
+    out->chunks = calloc(tags.count, sizeof(*out->chunks));
+    scan->seen = calloc(tags.count, 1);
+    if (!out->chunks || !scan->seen)
+      return STITCH_ERR_NOMEM;
+    out->count = out->capacity = tags.count;
+  }
+  else if (tags.count != out->count || strcmp(tags.plan, scan->plan_id))
+  {
+    return STITCH_ERR_LAYOUT;
+  }
+
+  out->chunks[tags.index] = (sc_chunk){
+      .index = tags.index,
+      .start = tags.start,
+      .end = tags.end};
+  scan->seen[tags.index] = 1;
+  return STITCH_OK;
+}
+
+static int scan_finish(chunk_scan *scan, int rc)
+{
+  if (rc == STITCH_OK && !scan->plan->chunks)
+    rc = STITCH_ERR_INPUT;
+  for (int i = 0; rc == STITCH_OK && i < scan->plan->count; i++)
+    if (!scan->seen[i])
+      rc = STITCH_ERR_INPUT;
+
+  free(scan->seen);
+  if (rc != STITCH_OK)
+    sc_free_chunk_plan(scan->plan);
+  return rc;
+}
+
+static int scan_pack(const char *pack_path, chunk_scan *scan)
+{
+  chunkpack pack;
+  if (chunkpack_open(pack_path, &pack) != PACK_OK)
+    return STITCH_ERR_OPEN;
+
+  int rc = STITCH_OK;
+  for (int i = 0; rc == STITCH_OK && i < pack.count; i++)
+  {
+    AVFormatContext *ctx = NULL;
+    if (chunkpack_open_chunk(&pack, pack.entries[i].index, NULL, &ctx) != PACK_OK)
+    {
+      rc = STITCH_ERR_OPEN;
+      break;
+    }
+    rc = scan_add_chunk(scan, ctx, pack.entries[i].index);
+    chunkpack_close_chunk(&ctx);
+  }
+
+  chunkpack_close(&pack);
+  return scan_finish(scan, rc);
+}
+
+int stitch_scan_chunks(const char *chunk_dir,
+                       const char *chunk_ext,
+                       const char *pack_path,
+                       sc_chunk_plan *out)
+{
+  if (!chunk_dir || !out)
+    return STITCH_ERR_INPUT;
+
+  memset(out, 0, sizeof(*out));
+  if (!chunk_ext)
+    chunk_ext = "mp4";
+
+  chunk_scan scan = {.plan = out, .seen = NULL, .plan_id = ""};
+
+  // Packed chunks: the pack holds the whole plan
+  if (pack_path)
+    return scan_pack(pack_path, &scan);
+
+  DIR *dir = opendir(chunk_dir);
+  if (!dir)
+    return STITCH_ERR_OPEN;
+
+  int rc = STITCH_OK;
+  struct dirent *de;
+  char path[PATH_MAX];
+
+  while (rc == STITCH_OK && (de = readdir(dir)) != NULL)
+  {
+    int index = 0;
+    char ext[16];
+    if (sscanf(de->d_name, "chunk_%d.%15s", &index, ext) != 2 ||
+        strcasecmp(ext, chunk_ext))
+      continue;
+
+    if (snprintf(path, sizeof(path), "%s/%s", chunk_dir, de->d_name) >= (int)sizeof(path))
+      continue;
+
+    // The header alone carries the tags; no stream probing needed
+    AVFormatContext *ctx = NULL;
+    if (avformat_open_input(&ctx, path, NULL, NULL) < 0)
+    {
+      rc = STITCH_ERR_OPEN;
+      break;
+    }
+
+    merge_tag_sidecar(ctx, path);
+    rc = scan_add_chunk(&scan, ctx, index);
+    avformat_close_input(&ctx);
+  }
+  closedir(dir);
+
+  return scan_finish(&scan, rc);
+}
+
+static void close_chunk_input(AVFormatContext **ctx, int from_pack)
+{
+  if (from_pack)
+    chunkpack_close_chunk(ctx);
+  else
+    avformat_close_input(ctx);
+}
+
 static int64_t resolve_first_ts(const AVPacket *pkt)
 {
   if (pkt->pts != AV_NOPTS_VALUE)
@@ -61,38 +334,174 @@ static int64_t resolve_first_ts(const AVPacket *pkt)
   return 0;
 }
 
+// Build Annex-B/OBU extradata from the parameter sets at the head of an
+// elementary-stream chunk. The raw demuxers leave extradata empty, but the
+// mp4/mov muxers need it to write avcC/hvcC/av1C.
+static int es_fill_extradata(const char *path,
+                             const AVInputFormat *ifmt,
+                             AVCodecParameters *par)
+{
+  if (par->extradata_size > 0)
+    return STITCH_OK;
+
+  const AVBitStreamFilter *filter = av_bsf_get_by_name("extract_extradata");
+  if (!filter)
+    return STITCH_ERR_FFMPEG;
+
+  AVFormatContext *in_ctx = NULL;
+  if (avformat_open_input(&in_ctx, path, ifmt, NULL) < 0)
+    return STITCH_ERR_OPEN;
+
+  AVBSFContext *bsf = NULL;
+  AVPacket *pkt = av_packet_alloc();
+  int rc = STITCH_ERR_STREAM;
+
+  if (!pkt || in_ctx->nb_streams < 1 || av_bsf_alloc(filter, &bsf) < 0)
+  {
+    rc = pkt ? STITCH_ERR_FFMPEG : STITCH_ERR_NOMEM;
+    goto done;
+  }
+
+  if (avcodec_parameters_copy(bsf->par_in, in_ctx->streams[0]->codecpar) < 0 ||
+      av_bsf_init(bsf) < 0)
+  {
+    rc = STITCH_ERR_FFMPEG;
+    goto done;
+  }
+
+  // Parameter sets precede the first keyframe; a handful of packets is enough
+  for (int n = 0; n < 16 && rc != STITCH_OK && av_read_frame(in_ctx, pkt) >= 0; n++)
+  {
+    if (av_bsf_send_packet(bsf, pkt) < 0)
+    {
+      av_packet_unref(pkt);
+      break;
+    }
+
+    while (av_bsf_receive_packet(bsf, pkt) >= 0)
+    {
+      size_t size = 0;
+      uint8_t *data = av_packet_get_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA, &size);
+      if (data && size > 0 && rc != STITCH_OK)
+      {
+        par->extradata = av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!par->extradata)
+        {
+          av_packet_unref(pkt);
+          rc = STITCH_ERR_NOMEM;
+          goto done;
+        }
+        memcpy(par->extradata, data, size);
+        par->extradata_size = (int)size;
+        rc = STITCH_OK;
+      }
+      av_packet_unref(pkt);
+    }
+  }
+
+done:
+  av_bsf_free(&bsf);
+  av_packet_free(&pkt);
+  avformat_close_input(&in_ctx);
+  return rc;
+}
+
 int stitch_chunks(const char *output_path,
                   const sc_chunk_plan *plan,
                   const char *chunk_dir,
                   const stitch_output_mode *mode)
 {
-  if (!output_path || !plan || !chunk_dir || plan->count <= 0)
+  return stitch_chunks_ex(output_path, plan, chunk_dir, NULL, mode);
+}
+
+int stitch_chunks_ex(const char *output_path,
+                     const sc_chunk_plan *plan,
+                     const char *chunk_dir,
+                     const stitch_input_mode *input,
+                     const stitch_output_mode *mode)
+{
+  const int custom_io = mode && mode->write_cb;
+  if ((!output_path && !custom_io) || !plan || !chunk_dir || plan->count <= 0)
     return STITCH_ERR_INPUT;
 
+  // "-" is stdout; FFmpeg's protocol layer spells that pipe:1
+  const char *out_url = output_path ? output_path : "-";
+  const int streaming = custom_io || stitch_is_pipe_output(out_url);
+  if (!strcmp(out_url, "-"))
+    out_url = "pipe:1";
+
+  const char *chunk_ext = (input && input->chunk_ext) ? input->chunk_ext : "mp4";
+  const int es_input = input && input->es_input;
+  const int from_pack = input && input->pack_path;
+  const double audio_preroll = input ? input->audio_preroll : 0.0;
+  const AVInputFormat *es_ifmt = NULL;
+  AVRational es_rate = {0, 1};
+  int es_has_ts = 0;
+
+  if (es_input)
+  {
+    const char *es_name = detect_es_fmt(chunk_ext);
+    es_ifmt = es_name ? av_find_input_format(es_name) : NULL;
+    if (!es_ifmt || from_pack)
+      return STITCH_ERR_INPUT;
+
+    // IVF carries per-frame timestamps; Annex-B and OBU streams do not
+    es_has_ts = !strcmp(es_name, "ivf");
+    if (input->fps_num > 0 && input->fps_den > 0)
+      es_rate = (AVRational){input->fps_num, input->fps_den};
+    // Annex-B/OBU frames are counted, so a guessed rate would retime them
+    if (!es_has_ts && es_rate.num <= 0)
+    {
+      av_log(NULL, AV_LOG_ERROR, "stitch: raw %s chunks need a frame rate\n", es_name);
+      return STITCH_ERR_INPUT;
+    }
+  }
+
   stitch_output_mode fallback = {
       .auto_mode = 1,
       .force_fmt = NULL,
       .output_frag = 0,
-      .enable_faststart = 0};
+      .enable_faststart = 0,
+      .package = STITCH_PACKAGE_NONE,
+      .segment_dur = 0.0,
+      .write_cb = NULL,
+      .write_opaque = NULL};
   const stitch_output_mode *cfg = mode ? mode : &fallback;
 
-  const char *fmt_name =
-      cfg->auto_mode ? detect_fmt(output_path)
-                     : (cfg->force_fmt ? cfg->force_fmt : "mp4");
+  const char *fmt_name = package_fmt(cfg->package);
+  if (fmt_name && streaming)
+    return STITCH_ERR_OUTPUT; /* segmenters write many files */
+  if (!fmt_name)
+    fmt_name = cfg->auto_mode ? detect_fmt(out_url)
+                              : (cfg->force_fmt ? cfg->force_fmt : "mp4");
 
   const AVOutputFormat *ofmt = av_guess_format(fmt_name, NULL, NULL);
   if (!ofmt)
     return STITCH_ERR_OUTPUT;
 
   AVFormatContext *out_ctx = NULL;
-  if (avformat_alloc_output_context2(&out_ctx, ofmt, fmt_name, output_path) < 0)
+  if (avformat_alloc_output_context2(&out_ctx, ofmt, fmt_name, out_url) < 0)
     return STITCH_ERR_OUTPUT;
 
   AVDictionary *mux_opts = NULL;
-  if (cfg->output_frag && !strcmp(fmt_name, "mp4"))
-    av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+omit_tfhd_offset", 0);
-  if (cfg->enable_faststart && !cfg->output_frag && !strcmp(fmt_name, "mp4"))
-    av_dict_set(&mux_opts, "movflags", "faststart", 0);
+  const int is_isobmff = !strcmp(fmt_name, "mp4") || !strcmp(fmt_name, "mov");
+  if (streaming && is_isobmff)
+  {
+    // Progressive MP4 seeks back to patch moov; fragments never do
+    av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+  }
+  else
+  {
+    if (cfg->output_frag && !strcmp(fmt_name, "mp4"))
+      av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+omit_tfhd_offset", 0);
+    if (cfg->enable_faststart && !cfg->output_frag && !strcmp(fmt_name, "mp4"))
+      av_dict_set(&mux_opts, "movflags", "faststart", 0);
+  }
+  set_package_opts(&mux_opts, fmt_name, cfg->package, cfg->segment_dur);
+
+  // Push each packet through to the pipe/callback instead of batching
+  if (streaming)
+    out_ctx->flush_packets = 1;
 
   // For bit-perfect reconstruction, disable automatic timestamp shifting
   // This preserves negative DTS values from the source
@@ -102,44 +511,99 @@ int stitch_chunks(const char *output_path,
   if (!pkt)
   {
     avformat_free_context(out_ctx);
+    av_dict_free(&mux_opts);
     return STITCH_ERR_NOMEM;
   }
 
+  if (custom_io)
+  {
+    // No seek callback: muxers see a non-seekable stream
+    unsigned char *io_buf = av_malloc(STITCH_IO_BUFSIZE);
+    if (io_buf)
+      out_ctx->pb = avio_alloc_context(io_buf, STITCH_IO_BUFSIZE, 1,
+                                       cfg->write_opaque, NULL, cfg->write_cb, NULL);
+    if (!out_ctx->pb)
+    {
+      av_free(io_buf);
+      av_packet_free(&pkt);
+      avformat_free_context(out_ctx);
+      av_dict_free(&mux_opts);
+      return STITCH_ERR_NOMEM;
+    }
+    out_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
   stitch_stream_state *streams = NULL;
   int stream_count = 0;
   int header_written = 0;
   int rc = STITCH_OK;
 
-  for (int ci = 0; ci < plan->count; ci++)
+  chunkpack pack;
+  int pack_open = 0;
+  if (from_pack)
+  {
+    if (chunkpack_open(input->pack_path, &pack) == PACK_OK)
+      pack_open = 1;
+    else
+      rc = STITCH_ERR_OPEN;
+  }
+
+  for (int ci = 0; rc == STITCH_OK && ci < plan->count; ci++)
   {
     char chunk_path[PATH_MAX];
-    if (chunk_abs_path(chunk_path, sizeof(chunk_path), chunk_dir, plan->chunks[ci].index) != 0)
+    if (chunk_file_path(chunk_path, sizeof(chunk_path), chunk_dir,
+                        plan->chunks[ci].index, chunk_ext) != 0)
     {
       rc = STITCH_ERR_OPEN;
       break;
     }
 
     AVFormatContext *in_ctx = NULL;
-    if (avformat_open_input(&in_ctx, chunk_path, NULL, NULL) < 0)
+    if (from_pack)
+    {
+      if (chunkpack_open_chunk(&pack, plan->chunks[ci].index, NULL, &in_ctx) != PACK_OK)
+      {
+        rc = STITCH_ERR_OPEN;
+        break;
+      }
+    }
+    else if (avformat_open_input(&in_ctx, chunk_path, es_ifmt, NULL) < 0)
     {
       rc = STITCH_ERR_OPEN;
       break;
     }
+    else
+    {
+      merge_tag_sidecar(in_ctx, chunk_path);
+    }
     if (avformat_find_stream_info(in_ctx, NULL) < 0)
     {
-      avformat_close_input(&in_ctx);
+      close_chunk_input(&in_ctx, from_pack);
       rc = STITCH_ERR_FFMPEG;
       break;
     }
+    // Counted frames are in decode order: pts == dts cannot express reordering
+    if (es_input && !es_has_ts && in_ctx->nb_streams > 0 &&
+        in_ctx->streams[0]->codecpar->video_delay > 0)
+    {
+      av_log(NULL, AV_LOG_ERROR,
+             "stitch: %s has reordered frames (B-frames); deliver it in a container\n",
+             chunk_path);
+      close_chunk_input(&in_ctx, from_pack);
+      rc = STITCH_ERR_STREAM;
+      break;
+    }
 
     const int chunk_streams = (int)in_ctx->nb_streams;
     int *chunk_map = malloc(sizeof(int) * chunk_streams);
     int64_t *first_pts = malloc(sizeof(int64_t) * chunk_streams);
-    if (!chunk_map || !first_pts)
+    int64_t *es_frames = calloc(chunk_streams, sizeof(int64_t));
+    if (!chunk_map || !first_pts || !es_frames)
     {
       free(chunk_map);
       free(first_pts);
-      avformat_close_input(&in_ctx);
+      free(es_frames);
+      close_chunk_input(&in_ctx, from_pack);
       rc = STITCH_ERR_NOMEM;
       break;
     }
@@ -165,7 +629,8 @@ int stitch_chunks(const char *output_path,
       {
         free(chunk_map);
         free(first_pts);
-        avformat_close_input(&in_ctx);
+        free(es_frames);
+        close_chunk_input(&in_ctx, from_pack);
         rc = STITCH_ERR_NOMEM;
         break;
       }
@@ -196,12 +661,36 @@ int stitch_chunks(const char *output_path,
         // Copy side data
         av_dict_copy(&ost->metadata, ist->metadata, 0);
 
+        AVRational state_tb = ist->time_base;
+        if (es_input)
+        {
+          // IVF without a caller rate takes the demuxer's; its frames keep
+          // their own timestamps either way
+          if (es_rate.num <= 0)
+            es_rate = ist->avg_frame_rate.num > 0 ? ist->avg_frame_rate : ist->r_frame_rate;
+          if (es_rate.num <= 0 || es_rate.den <= 0)
+          {
+            rc = STITCH_ERR_STREAM;
+            break;
+          }
+
+          // ES timestamps are counted in frames
+          state_tb = av_inv_q(es_rate);
+          ost->time_base = state_tb;
+          ost->avg_frame_rate = es_rate;
+          ost->r_frame_rate = es_rate;
+
+          rc = es_fill_extradata(chunk_path, es_ifmt, ost->codecpar);
+          if (rc != STITCH_OK)
+            break;
+        }
+
         streams[st_idx].out_index = ost->index;
         streams[st_idx].offset = 0;
         streams[st_idx].last_pts = AV_NOPTS_VALUE;
         streams[st_idx].last_dts = AV_NOPTS_VALUE;
         streams[st_idx].last_duration = 0;
-        streams[st_idx].time_base = ist->time_base;
+        streams[st_idx].time_base = state_tb;
         streams[st_idx].type = ist->codecpar->codec_type;
         st_idx++;
       }
@@ -210,18 +699,20 @@ int stitch_chunks(const char *output_path,
       {
         free(chunk_map);
         free(first_pts);
-        avformat_close_input(&in_ctx);
+        free(es_frames);
+        close_chunk_input(&in_ctx, from_pack);
         break;
       }
 
-      if (!(out_ctx->oformat->flags & AVFMT_NOFILE))
+      if (!custom_io && !(out_ctx->oformat->flags & AVFMT_NOFILE))
       {
-        if (avio_open(&out_ctx->pb, output_path, AVIO_FLAG_WRITE) < 0)
+        if (avio_open(&out_ctx->pb, out_url, AVIO_FLAG_WRITE) < 0)
         {
           rc = STITCH_ERR_OUTPUT;
           free(chunk_map);
           free(first_pts);
-          avformat_close_input(&in_ctx);
+          free(es_frames);
+          close_chunk_input(&in_ctx, from_pack);
           break;
         }
       }
@@ -231,7 +722,8 @@ int stitch_chunks(const char *output_path,
         rc = STITCH_ERR_WRITE;
         free(chunk_map);
         free(first_pts);
-        avformat_close_input(&in_ctx);
+        free(es_frames);
+        close_chunk_input(&in_ctx, from_pack);
         break;
       }
 
@@ -244,7 +736,8 @@ int stitch_chunks(const char *output_path,
         rc = STITCH_ERR_LAYOUT;
         free(chunk_map);
         free(first_pts);
-        avformat_close_input(&in_ctx);
+        free(es_frames);
+        close_chunk_input(&in_ctx, from_pack);
         break;
       }
     }
@@ -252,13 +745,16 @@ int stitch_chunks(const char *output_path,
     // Track the maximum timestamp for each stream before processing packets
     int64_t *max_pts_in_chunk = calloc(chunk_streams, sizeof(int64_t));
     int64_t *max_dts_in_chunk = calloc(chunk_streams, sizeof(int64_t));
-    if (!max_pts_in_chunk || !max_dts_in_chunk)
+    int64_t *trim_until = calloc(chunk_streams, sizeof(int64_t));
+    if (!max_pts_in_chunk || !max_dts_in_chunk || !trim_until)
     {
       free(max_pts_in_chunk);
       free(max_dts_in_chunk);
+      free(trim_until);
       free(chunk_map);
       free(first_pts);
-      avformat_close_input(&in_ctx);
+      free(es_frames);
+      close_chunk_input(&in_ctx, from_pack);
       rc = STITCH_ERR_NOMEM;
       break;
     }
@@ -266,6 +762,20 @@ int stitch_chunks(const char *output_path,
     {
       max_pts_in_chunk[i] = AV_NOPTS_VALUE;
       max_dts_in_chunk[i] = AV_NOPTS_VALUE;
+      trim_until[i] = AV_NOPTS_VALUE;
+    }
+
+    // Trim what the split copied (its tag), on audio-only chunks only;
+    // chunks that were not split by us fall back to audio_preroll
+    double chunk_preroll = 0.0;
+    if (ci > 0 && !es_input &&
+        av_find_best_stream(in_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0) < 0)
+    {
+      const AVDictionaryEntry *pre = av_dict_get(in_ctx->metadata, SPLIT_TAG_PREROLL, NULL, 0);
+      if (pre)
+        chunk_preroll = strtod(pre->value, NULL);
+      else if (!av_dict_get(in_ctx->metadata, SPLIT_TAG_INDEX, NULL, 0))
+        chunk_preroll = fmin(audio_preroll, plan->chunks[ci].start);
     }
 
     while (av_read_frame(in_ctx, pkt) >= 0)
@@ -281,6 +791,46 @@ int stitch_chunks(const char *output_path,
       AVStream *ist = in_ctx->streams[pkt->stream_index];
       AVStream *ost = out_ctx->streams[state->out_index];
 
+      if (es_input)
+      {
+        // IVF chunks are placed at their plan start and keep their relative
+        // spacing. Annex-B/OBU frames are numbered in decode order by one
+        // counter that runs across chunks, so pts == dts and no frame is
+        // skipped or doubled where a plan start is off the frame grid.
+        int64_t base = llrint(plan->chunks[ci].start * av_q2d(es_rate));
+        int64_t n = es_frames[pkt->stream_index]++;
+        int64_t ts = base + n;
+
+        if (!es_has_ts)
+          ts = state->last_dts == AV_NOPTS_VALUE ? base : state->last_dts + 1;
+        else if (pkt->pts != AV_NOPTS_VALUE)
+        {
+          if (first_pts[pkt->stream_index] == AV_NOPTS_VALUE)
+            first_pts[pkt->stream_index] = pkt->pts;
+          ts = base + av_rescale_q(pkt->pts - first_pts[pkt->stream_index],
+                                   ist->time_base, state->time_base);
+        }
+
+        pkt->pts = ts;
+        pkt->dts = ts;
+        pkt->duration = 1;
+        av_packet_rescale_ts(pkt, state->time_base, ost->time_base);
+        pkt->stream_index = state->out_index;
+        pkt->pos = -1;
+
+        if (av_interleaved_write_frame(out_ctx, pkt) < 0)
+        {
+          rc = STITCH_ERR_WRITE;
+          av_packet_unref(pkt);
+          break;
+        }
+
+        state->last_pts = ts;
+        state->last_dts = ts;
+        av_packet_unref(pkt);
+        continue;
+      }
+
       if (av_cmp_q(ist->time_base, state->time_base) != 0)
       {
         rc = STITCH_ERR_LAYOUT;
@@ -288,6 +838,31 @@ int stitch_chunks(const char *output_path,
         break;
       }
 
+      // Audio pre-roll: drop the encoder priming and the copy of the
+      // previous chunk's tail, whole packets only. The chunk's timeline
+      // starts at zero when priming was pushed below it (edit list),
+      // otherwise at its first packet plus initial_padding.
+      if (chunk_preroll > 0.0 && state->type == AVMEDIA_TYPE_AUDIO)
+      {
+        int si = pkt->stream_index;
+        int64_t ts = resolve_first_ts(pkt);
+        if (trim_until[si] == AV_NOPTS_VALUE)
+        {
+          const AVCodecParameters *par = ist->codecpar;
+          int64_t origin = ts < 0 ? 0 : ts;
+          if (ts >= 0 && par->initial_padding > 0 && par->sample_rate > 0)
+            origin += av_rescale_q(par->initial_padding,
+                                   (AVRational){1, par->sample_rate}, ist->time_base);
+          trim_until[si] = origin + av_rescale_q(llrint(chunk_preroll * AV_TIME_BASE),
+                                                 AV_TIME_BASE_Q, ist->time_base);
+        }
+        if (ts + pkt->duration / 2 < trim_until[si])
+        {
+          av_packet_unref(pkt);
+          continue;
+        }
+      }
+
       // For the first chunk (ci == 0), preserve exact timestamps
       // For subsequent chunks, we need to offset them
       int64_t rebased_pts = AV_NOPTS_VALUE;
@@ -329,6 +904,7 @@ int stitch_chunks(const char *output_path,
            rebased_pts > max_pts_in_chunk[pkt->stream_index]))
       {
         max_pts_in_chunk[pkt->stream_index] = rebased_pts;
+        state->last_duration = pkt->duration;
       }
       if (rebased_dts != AV_NOPTS_VALUE &&
           (max_dts_in_chunk[pkt->stream_index] == AV_NOPTS_VALUE ||
@@ -387,6 +963,9 @@ int stitch_chunks(const char *output_path,
         int64_t duration = ist->avg_frame_rate.num > 0
             ? av_rescale_q(1, av_inv_q(ist->avg_frame_rate), ist->time_base)
             : 1;
+        // Audio has no frame rate; its packets carry their duration
+        if (streams[s].type == AVMEDIA_TYPE_AUDIO && streams[s].last_duration > 0)
+          duration = streams[s].last_duration;
 
         // Next chunk offset = max timestamp + one frame duration
         streams[s].offset = tail + duration;
@@ -395,15 +974,20 @@ int stitch_chunks(const char *output_path,
 
     free(max_pts_in_chunk);
     free(max_dts_in_chunk);
+    free(trim_until);
 
     free(chunk_map);
     free(first_pts);
-    avformat_close_input(&in_ctx);
+    free(es_frames);
+    close_chunk_input(&in_ctx, from_pack);
 
     if (rc != STITCH_OK)
       break;
   }
 
+  if (pack_open)
+    chunkpack_close(&pack);
+
   if (rc == STITCH_OK)
   {
     if (!header_written)
@@ -414,15 +998,18 @@ int stitch_chunks(const char *output_path,
 
   if (pkt)
     av_packet_free(&pkt);
-  if (out_ctx && !(out_ctx->oformat->flags & AVFMT_NOFILE))
+  if (custom_io)
+  {
+    // The caller owns the sink; we own the AVIO wrapper and its buffer
+    avio_flush(out_ctx->pb);
+    av_freep(&out_ctx->pb->buffer);
+    avio_context_free(&out_ctx->pb);
+  }
+  else if (!(out_ctx->oformat->flags & AVFMT_NOFILE))
     avio_closep(&out_ctx->pb);
-  if (out_ctx)
-    avformat_free_context(out_ctx);
+  avformat_free_context(out_ctx);
   av_dict_free(&mux_opts);
   free(streams);
 
-  if (rc != STITCH_OK && !header_written && out_ctx && out_ctx->pb)
-    avio_closep(&out_ctx->pb);
-
   return rc;
 }
@@ -21,6 +21,17 @@ enum
     STITCH_ERR_LAYOUT = -37
 };
 
+  // -----------------------------------------------------------
+  // Packaging targets (output_path is the playlist/manifest)
+  // -----------------------------------------------------------
+enum
+{
+    STITCH_PACKAGE_NONE = 0,
+    STITCH_PACKAGE_HLS = 1,  /* fMP4 segments + HLS media playlist */
+    STITCH_PACKAGE_DASH = 2, /* CMAF segments + DASH MPD */
+    STITCH_PACKAGE_CMAF = 3  /* CMAF segments + DASH MPD + HLS playlists */
+};
+
   // -----------------------------------------------------------
   // Output format selector
   // -----------------------------------------------------------
@@ -30,16 +41,73 @@ typedef struct
     const char *force_fmt;
     int output_frag;
     int enable_faststart;
+    int package;           /* STITCH_PACKAGE_* (auto: .m3u8 / .mpd) */
+    double segment_dur;    /* packaged segment duration (0 = 6s) */
+
+    /* Optional write callback for embedding. When set, output bytes go
+       here instead of output_path (which may be NULL and is only used to
+       pick the muxer). The output is treated as non-seekable. */
+    int (*write_cb)(void *opaque, const uint8_t *buf, int size);
+    void *write_opaque;
 } stitch_output_mode;
 
+  // -----------------------------------------------------------
+  // Input chunk selector
+  // -----------------------------------------------------------
+typedef struct
+{
+    const char *chunk_ext; /* chunk file extension (NULL = "mp4") */
+    int es_input;          /* chunks are raw elementary streams (Annex-B/IVF/OBU) */
+    int fps_num;           /* ES frame rate (Annex-B/OBU: required;
+                              IVF: 0 = take from the demuxer) */
+    int fps_den;
+    const char *pack_path; /* read chunks from this pack instead of chunk_dir */
+    double audio_preroll;  /* audio-only chunks after the first start this
+                              early (split_output_mode.audio_preroll); the
+                              head and the encoder priming are dropped.
+                              Chunks we split carry the amount in their
+                              tags (SPLIT_TAG_PREROLL), which wins */
+} stitch_input_mode;
+
   // ---------------------------------------------------------
-  // Concatenate sequential chunks
+  // Concatenate sequential chunks. An output_path of "-" or
+  // "pipe:N" streams to stdout/an fd: progressive MP4/MOV is
+  // switched to fragmented output, MKV/TS are written as-is.
   // ---------------------------------------------------------
 int stitch_chunks(const char *output_path,
                   const sc_chunk_plan *plan,
                   const char *chunk_dir,
                   const stitch_output_mode *mode);
 
+  // ---------------------------------------------------------
+  // Concatenate sequential chunks with an explicit input mode.
+  // In ES mode IVF chunks are placed at their plan start,
+  // Annex-B/OBU frames are counted across chunks at the frame
+  // rate, and missing extradata is built from the first
+  // chunk's parameter sets.
+  // ---------------------------------------------------------
+int stitch_chunks_ex(const char *output_path,
+                     const sc_chunk_plan *plan,
+                     const char *chunk_dir,
+                     const stitch_input_mode *input,
+                     const stitch_output_mode *mode);
+
+  // ---------------------------------------------------------
+  // Rebuild the plan from the container tags the splitter
+  // writes into chunk_NNNN.<ext> files (or, with pack_path,
+  // into the chunks of that pack), so a stitch needs no
+  // source probe. Fails if chunks are untagged, missing, or
+  // come from different plans.
+  // ---------------------------------------------------------
+int stitch_scan_chunks(const char *chunk_dir,
+                       const char *chunk_ext,
+                       const char *pack_path,
+                       sc_chunk_plan *out);
+
+  // True when output_path names stdout ("-" or a pipe: URL),
+  // where the stitched stream leaves no room for other output.
+int stitch_is_pipe_output(const char *output_path);
+
 #ifdef __cplusplus
 }
 #endif
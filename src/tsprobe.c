@@ -0,0 +1,511 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "smartchunk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Native MPEG-TS probe. Walks the transport packets directly instead of
+ * letting libavformat assemble every PES: for the video PID only the
+ * adaptation field (random_access_indicator) and the PES header
+ * (PTS/DTS) are parsed, and a PES's size is the sum of its payload
+ * lengths. Payloads are never copied.
+ */
+
+#define TS_PACKET 188
+#define TS_SYNC 0x47
+#define TS_CLOCK 90000.0
+#define TS_READ_SIZE (4 * 1024 * 1024)
+#define TS_SYNC_CHECK 5 // consecutive sync bytes needed to lock on
+
+#define TS_PID_PAT 0x0000
+#define TS_PID_NONE -1
+
+typedef struct
+{
+  int have;
+  int64_t last;
+  int64_t wrap;
+} ts_clock;
+
+typedef struct
+{
+  int stride; // 188, 192 (M2TS timecode prefix) or 204 (RS parity)
+  int pmt_pid;
+  int video_pid;
+
+  // PES currently being accumulated on the video PID
+  int pes_open;
+  int64_t pes_bytes;
+  int64_t pes_pts;
+  int64_t pes_dts;
+  int pes_key;
+  int pes_header_left; // PES header bytes still to skip (split header)
+
+  ts_clock pts_clock;
+  ts_clock dts_clock;
+  int64_t max_pts;
+  int64_t first_dts;
+  int64_t last_dts;
+  int64_t dts_count;
+  double last_time;
+  int saw_rai;
+
+  int keyframes_only;
+  sc_probe_result *out;
+} ts_scan;
+
+// ---------------------------------------------------------
+// Sync search: SSE2 compares 16 bytes per step; the portable path
+// relies on the C library's memchr
+// ---------------------------------------------------------
+static const uint8_t *ts_next_sync_byte(const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+  const __m128i sync = _mm_set1_epi8((char)TS_SYNC);
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, sync));
+    if (mask)
+      return p + __builtin_ctz((unsigned)mask);
+    p += 16;
+  }
+#endif
+  return p < end ? memchr(p, TS_SYNC, (size_t)(end - p)) : NULL;
+}
+
+// Sync bytes of the n packets starting at p, checked in one pass
+static int ts_sync_run(const uint8_t *p, size_t len, int stride, int n)
+{
+  if (len < (size_t)stride * (size_t)(n - 1) + TS_PACKET)
+    return 0;
+  uint8_t diff = 0;
+  for (int i = 0; i < n; i++)
+    diff |= (uint8_t)(p[(size_t)i * (size_t)stride] ^ TS_SYNC);
+  return diff == 0;
+}
+
+// First offset where TS_SYNC_CHECK packets line up, or -1
+static int64_t ts_find_lock(const uint8_t *buf, size_t len, int stride)
+{
+  const uint8_t *p = buf;
+  const uint8_t *end = buf + len;
+  while ((p = ts_next_sync_byte(p, end)) != NULL)
+  {
+    if (ts_sync_run(p, (size_t)(end - p), stride, TS_SYNC_CHECK))
+      return p - buf;
+    p++;
+  }
+  return -1;
+}
+
+static int ts_detect_stride(const uint8_t *buf, size_t len)
+{
+  static const int strides[] = {TS_PACKET, 192, 204};
+  for (size_t i = 0; i < sizeof(strides) / sizeof(strides[0]); i++)
+  {
+    int64_t off = ts_find_lock(buf, len, strides[i]);
+    if (off >= 0 && off < strides[i])
+      return strides[i];
+  }
+  return 0;
+}
+
+// 33-bit timestamps: unwrap against the previous value
+static int64_t ts_unwrap(ts_clock *c, int64_t raw)
+{
+  int64_t v = raw + c->wrap;
+  if (c->have && v < c->last - (1LL << 32))
+  {
+    c->wrap += 1LL << 33;
+    v += 1LL << 33;
+  }
+  if (!c->have || v > c->last)
+    c->last = v;
+  c->have = 1;
+  return v;
+}
+
+static int64_t ts_read_timestamp(const uint8_t *p)
+{
+  return ((int64_t)((p[0] >> 1) & 0x07) << 30) |
+         ((int64_t)p[1] << 22) |
+         ((int64_t)(p[2] >> 1) << 15) |
+         ((int64_t)p[3] << 7) |
+         ((int64_t)p[4] >> 1);
+}
+
+static int ts_is_video_type(int stream_type)
+{
+  switch (stream_type)
+  {
+  case 0x01: // MPEG-1 video
+  case 0x02: // MPEG-2 video
+  case 0x10: // MPEG-4 part 2
+  case 0x1B: // H.264
+  case 0x24: // HEVC
+  case 0x33: // VVC
+  case 0x42: // AVS
+  case 0xD1: // Dirac
+  case 0xEA: // VC-1
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// ---------------------------------------------------------
+// PSI: only sections that fit in one packet are parsed; PAT and PMT
+// repeat, so a split one is simply picked up next time
+// ---------------------------------------------------------
+static const uint8_t *ts_psi_section(const uint8_t *pl, int len, int table_id,
+                                     int *section_len)
+{
+  if (len < 1)
+    return NULL;
+  int pointer = pl[0];
+  if (1 + pointer + 3 > len)
+    return NULL;
+  const uint8_t *s = pl + 1 + pointer;
+  int slen = ((s[1] & 0x0F) << 8) | s[2];
+  if (s[0] != table_id || 1 + pointer + 3 + slen > len || slen < 9)
+    return NULL;
+  *section_len = slen;
+  return s;
+}
+
+static void ts_parse_pat(ts_scan *s, const uint8_t *pl, int len)
+{
+  int slen;
+  const uint8_t *sec = ts_psi_section(pl, len, 0x00, &slen);
+  if (!sec)
+    return;
+
+  const uint8_t *p = sec + 8;
+  const uint8_t *end = sec + 3 + slen - 4; // CRC
+  for (; p + 4 <= end; p += 4)
+  {
+    int program = (p[0] << 8) | p[1];
+    if (program != 0) // 0 is the network PID
+    {
+      s->pmt_pid = ((p[2] & 0x1F) << 8) | p[3];
+      return;
+    }
+  }
+}
+
+static void ts_parse_pmt(ts_scan *s, const uint8_t *pl, int len)
+{
+  int slen;
+  const uint8_t *sec = ts_psi_section(pl, len, 0x02, &slen);
+  if (!sec || slen < 13)
+    return;
+
+  int info_len = ((sec[10] & 0x0F) << 8) | sec[11];
+  const uint8_t *p = sec + 12 + info_len;
+  const uint8_t *end = sec + 3 + slen - 4;
+  while (p + 5 <= end)
+  {
+    int type = p[0];
+    int pid = ((p[1] & 0x1F) << 8) | p[2];
+    int es_info_len = ((p[3] & 0x0F) << 8) | p[4];
+    if (ts_is_video_type(type))
+    {
+      s->video_pid = pid;
+      return;
+    }
+    p += 5 + es_info_len;
+  }
+}
+
+// ---------------------------------------------------------
+// PES accounting on the video PID
+// ---------------------------------------------------------
+static int ts_emit_pes(ts_scan *s)
+{
+  if (!s->pes_open)
+    return SC_OK;
+  s->pes_open = 0;
+
+  double t = s->last_time;
+  if (s->pes_pts >= 0)
+  {
+    int64_t pts = ts_unwrap(&s->pts_clock, s->pes_pts);
+    if (pts > s->max_pts)
+      s->max_pts = pts;
+    t = pts / TS_CLOCK;
+  }
+  s->last_time = t;
+
+  int64_t dts_raw = s->pes_dts >= 0 ? s->pes_dts : s->pes_pts;
+  if (dts_raw >= 0)
+  {
+    int64_t dts = ts_unwrap(&s->dts_clock, dts_raw);
+    if (s->dts_count == 0)
+      s->first_dts = dts;
+    s->last_dts = dts;
+    s->dts_count++;
+  }
+
+  sc_probe_result *out = s->out;
+
+  // Keyframe-only: fold the frame into the open GOP's aggregate
+  if (s->keyframes_only && !s->pes_key && out->count > 0)
+  {
+    sc_frame_meta *gop = &out->frames[out->count - 1];
+    gop->pkt_size += s->pes_bytes;
+    gop->frame_span++;
+    if (t < gop->pts_time)
+      gop->open_gop = 1;
+    return SC_OK;
+  }
+
+  if (out->count + 1 > out->capacity)
+  {
+    int64_t newcap = out->capacity ? out->capacity * 2 : 2048;
+    sc_frame_meta *frames = realloc(out->frames, (size_t)newcap * sizeof(*frames));
+    if (!frames)
+      return SC_ERR_NOMEM;
+    out->frames = frames;
+    out->capacity = newcap;
+  }
+
+  sc_frame_meta *fm = &out->frames[out->count++];
+  memset(fm, 0, sizeof(*fm));
+  fm->pts_time = t;
+  fm->is_keyframe = s->pes_key;
+  fm->pkt_size = s->pes_bytes;
+  fm->pict_type = s->pes_key ? 1 : 0;
+  fm->frame_span = 1;
+  return SC_OK;
+}
+
+static int ts_video_packet(ts_scan *s, const uint8_t *pl, int len, int pusi, int rai)
+{
+  if (pusi)
+  {
+    int r = ts_emit_pes(s);
+    if (r != SC_OK)
+      return r;
+
+    if (len < 9 || pl[0] != 0 || pl[1] != 0 || pl[2] != 1)
+      return SC_OK; // not a PES start: drop until the next one
+
+    s->pes_open = 1;
+    s->pes_key = rai;
+    s->pes_pts = -1;
+    s->pes_dts = -1;
+
+    int flags = pl[7] >> 6;
+    int header = 9 + pl[8];
+    if ((flags & 0x2) && len >= 14)
+      s->pes_pts = ts_read_timestamp(pl + 9);
+    if (flags == 0x3 && len >= 19)
+      s->pes_dts = ts_read_timestamp(pl + 14);
+
+    int skip = header < len ? header : len;
+    s->pes_header_left = header - skip;
+    s->pes_bytes = len - skip;
+    return SC_OK;
+  }
+
+  if (!s->pes_open)
+    return SC_OK;
+
+  if (rai)
+    s->pes_key = 1;
+  if (s->pes_header_left > 0)
+  {
+    int skip = s->pes_header_left < len ? s->pes_header_left : len;
+    s->pes_header_left -= skip;
+    len -= skip;
+  }
+  s->pes_bytes += len;
+  return SC_OK;
+}
+
+static int ts_packet(ts_scan *s, const uint8_t *p)
+{
+  if (p[1] & 0x80) // transport_error_indicator
+    return SC_OK;
+
+  int pusi = (p[1] & 0x40) != 0;
+  int pid = ((p[1] & 0x1F) << 8) | p[2];
+  int afc = (p[3] >> 4) & 0x3;
+
+  // Everything but PSI and the video PID is skipped on the PID alone
+  if (pid != TS_PID_PAT && pid != s->pmt_pid && pid != s->video_pid)
+    return SC_OK;
+
+  int off = 4;
+  int rai = 0;
+  if (afc & 0x2)
+  {
+    int af_len = p[4];
+    if (af_len > 0)
+      rai = (p[5] & 0x40) != 0;
+    off = 5 + af_len;
+    if (off > TS_PACKET)
+      return SC_OK;
+  }
+  if (!(afc & 0x1))
+    return SC_OK;
+
+  const uint8_t *pl = p + off;
+  int len = TS_PACKET - off;
+
+  if (pid == s->video_pid)
+  {
+    if (rai)
+      s->saw_rai = 1;
+    return ts_video_packet(s, pl, len, pusi, rai);
+  }
+  if (!pusi)
+    return SC_OK;
+  if (pid == TS_PID_PAT)
+    ts_parse_pat(s, pl, len);
+  else if (s->video_pid == TS_PID_NONE)
+    ts_parse_pmt(s, pl, len);
+  return SC_OK;
+}
+
+// ---------------------------------------------------------
+// Read loop
+// ---------------------------------------------------------
+static ssize_t ts_fill(int fd, uint8_t *buf, size_t have, size_t cap)
+{
+  while (have < cap)
+  {
+    ssize_t n = read(fd, buf + have, cap - have);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    have += (size_t)n;
+  }
+  return (ssize_t)have;
+}
+
+int sc_probe_ts(const char *filename, int flags, sc_probe_result *out)
+{
+  if (!filename || !out)
+    return SC_ERR_INVAL;
+
+  memset(out, 0, sizeof(*out));
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return SC_ERR_FFMPEG;
+
+  int r = SC_OK;
+  uint8_t *buf = malloc(TS_READ_SIZE);
+  if (!buf)
+  {
+    close(fd);
+    return SC_ERR_NOMEM;
+  }
+
+  ts_scan s;
+  memset(&s, 0, sizeof(s));
+  s.pmt_pid = TS_PID_NONE;
+  s.video_pid = TS_PID_NONE;
+  s.max_pts = INT64_MIN;
+  s.keyframes_only = (flags & SC_PROBE_KEYFRAMES_ONLY) != 0;
+  s.out = out;
+  out->keyframes_only = s.keyframes_only;
+
+  ssize_t got = ts_fill(fd, buf, 0, TS_READ_SIZE);
+  if (got < 0)
+  {
+    r = SC_ERR_FFMPEG;
+    goto cleanup;
+  }
+  size_t len = (size_t)got;
+  s.stride = ts_detect_stride(buf, len);
+  if (!s.stride)
+  {
+    r = SC_ERR_INVAL; // not a transport stream
+    goto cleanup;
+  }
+
+  size_t pos = 0;
+  for (;;)
+  {
+    while (pos + TS_PACKET <= len)
+    {
+      if (buf[pos] != TS_SYNC)
+      {
+        // Lost sync: lock on to the next run of aligned packets
+        int64_t off = ts_find_lock(buf + pos, len - pos, s.stride);
+        if (off < 0)
+        {
+          // Keep a tail long enough to hold a lock candidate
+          size_t keep = (size_t)s.stride * TS_SYNC_CHECK;
+          if (len > keep && len - keep > pos)
+            pos = len - keep;
+          break;
+        }
+        pos += (size_t)off;
+        continue;
+      }
+      if ((r = ts_packet(&s, buf + pos)) != SC_OK)
+        goto cleanup;
+      pos += (size_t)s.stride;
+    }
+
+    if (len < TS_READ_SIZE)
+      break; // last read hit EOF
+
+    size_t rest = pos < len ? len - pos : 0;
+    memmove(buf, buf + len - rest, rest);
+    pos = 0;
+    got = ts_fill(fd, buf, rest, TS_READ_SIZE);
+    if (got < 0)
+    {
+      r = SC_ERR_FFMPEG;
+      goto cleanup;
+    }
+    len = (size_t)got;
+    if (len == rest)
+      break;
+  }
+
+  if ((r = ts_emit_pes(&s)) != SC_OK)
+    goto cleanup;
+
+  // No video PID or no random_access_indicator anywhere: keyframes are
+  // only visible in the bitstream, which is the demuxer's job
+  if (out->count == 0 || !s.saw_rai)
+  {
+    r = SC_ERR_INVAL;
+    goto cleanup;
+  }
+
+  double frame_dur = 0.0;
+  if (s.dts_count > 1)
+    frame_dur = (s.last_dts - s.first_dts) / (double)(s.dts_count - 1);
+  if (s.max_pts != INT64_MIN)
+    out->duration = (s.max_pts + frame_dur) / TS_CLOCK;
+  else
+    out->duration = s.last_time;
+
+cleanup:
+  if (r != SC_OK)
+    sc_free_probe(out);
+  free(buf);
+  close(fd);
+  return r;
+}
@@ -0,0 +1,339 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L /* pread */
+#endif
+
+#include "y4m.h"
+#include "rangeio.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_FRAME_MAGIC "FRAME"
+#define Y4M_HEADER_MAX 4096
+
+int y4m_detect(const char *path)
+{
+  const char *ext = path ? strrchr(path, '.') : NULL;
+  return ext && !strchr(ext, '/') && !strcasecmp(ext + 1, "y4m");
+}
+
+// Picture bytes for a C<tag> colourspace (default 420jpeg)
+static int64_t frame_bytes(const char *tag, int w, int h)
+{
+  int64_t luma = (int64_t)w * h;
+  int64_t cw2 = (int64_t)(w + 1) / 2;
+  int64_t ch2 = (int64_t)(h + 1) / 2;
+  int depth = 8;
+  int64_t samples;
+
+  if (!strncmp(tag, "mono", 4))
+  {
+    if (tag[4] >= '0' && tag[4] <= '9')
+      depth = atoi(tag + 4);
+    samples = luma;
+  }
+  else
+  {
+    // High bit depth: "420p10", "444p16", ... ("420jpeg" is 8-bit)
+    const char *p = strchr(tag, 'p');
+    if (p && p[1] >= '0' && p[1] <= '9')
+      depth = atoi(p + 1);
+    if (!strncmp(tag, "420", 3))
+      samples = luma + 2 * cw2 * ch2;
+    else if (!strncmp(tag, "411", 3))
+      samples = luma + 2 * ((int64_t)(w + 3) / 4) * h;
+    else if (!strncmp(tag, "422", 3))
+      samples = luma + 2 * cw2 * h;
+    else if (!strcmp(tag, "444alpha"))
+      samples = 4 * luma;
+    else if (!strncmp(tag, "444", 3))
+      samples = 3 * luma;
+    else
+      return -1;
+  }
+  if (depth <= 0)
+    return -1;
+  return samples * (depth > 8 ? 2 : 1);
+}
+
+static int parse_header(const char *hdr, y4m_info *y, char *tag, size_t tag_len)
+{
+  snprintf(tag, tag_len, "420jpeg");
+  y->fps_num = 0;
+  y->fps_den = 0;
+
+  for (const char *p = hdr + strlen(Y4M_MAGIC); *p; )
+  {
+    while (*p == ' ')
+      p++;
+    const char *tok = p;
+    while (*p && *p != ' ')
+      p++;
+    size_t n = (size_t)(p - tok);
+
+    switch (*tok)
+    {
+    case 'W':
+      y->width = atoi(tok + 1);
+      break;
+    case 'H':
+      y->height = atoi(tok + 1);
+      break;
+    case 'F':
+      if (sscanf(tok + 1, "%d:%d", &y->fps_num, &y->fps_den) != 2)
+        return Y4M_ERR_FORMAT;
+      break;
+    case 'C':
+      if (n - 1 >= tag_len)
+        return Y4M_ERR_FORMAT;
+      memcpy(tag, tok + 1, n - 1);
+      tag[n - 1] = '\0';
+      break;
+    default:
+      break; // interlacing, aspect, comments: layout-neutral
+    }
+  }
+
+  if (y->width <= 0 || y->height <= 0 || y->fps_num <= 0 || y->fps_den <= 0)
+    return Y4M_ERR_FORMAT;
+  return Y4M_OK;
+}
+
+// "FRAME" marker at frame i, which must match the first one's length
+static int frame_marker_ok(int fd, const y4m_info *y, int64_t i)
+{
+  char buf[64];
+  if (y->frame_header_len > (int64_t)sizeof(buf))
+    return 1; // parameters on the marker: length already validated
+  off_t off = (off_t)(y->header_len + i * (y->frame_header_len + y->frame_size));
+  if (pread(fd, buf, (size_t)y->frame_header_len, off) != (ssize_t)y->frame_header_len)
+    return 0;
+  return !memcmp(buf, Y4M_FRAME_MAGIC, strlen(Y4M_FRAME_MAGIC)) &&
+         buf[y->frame_header_len - 1] == '\n';
+}
+
+int y4m_open(const char *path, y4m_info *out)
+{
+  if (!path || !out)
+    return Y4M_ERR_FORMAT;
+  memset(out, 0, sizeof(*out));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return Y4M_ERR_OPEN;
+
+  int r = Y4M_OK;
+  char *hdr = malloc(Y4M_HEADER_MAX + 1);
+  if (!hdr)
+  {
+    close(fd);
+    return Y4M_ERR_NOMEM;
+  }
+
+  struct stat st;
+  ssize_t got = pread(fd, hdr, Y4M_HEADER_MAX, 0);
+  if (got <= 0 || fstat(fd, &st) != 0)
+  {
+    r = Y4M_ERR_IO;
+    goto cleanup;
+  }
+  hdr[got] = '\0';
+
+  char *nl = memchr(hdr, '\n', (size_t)got);
+  if (!nl || strncmp(hdr, Y4M_MAGIC, strlen(Y4M_MAGIC)))
+  {
+    r = Y4M_ERR_FORMAT;
+    goto cleanup;
+  }
+  *nl = '\0';
+  out->header_len = nl - hdr + 1;
+
+  char *fh = nl + 1;
+  char *fnl = memchr(fh, '\n', (size_t)(got - out->header_len));
+  if (!fnl || strncmp(fh, Y4M_FRAME_MAGIC, strlen(Y4M_FRAME_MAGIC)))
+  {
+    r = Y4M_ERR_FORMAT;
+    goto cleanup;
+  }
+  out->frame_header_len = fnl - fh + 1;
+
+  char tag[32];
+  if ((r = parse_header(hdr, out, tag, sizeof(tag))) != Y4M_OK)
+    goto cleanup;
+  out->frame_size = frame_bytes(tag, out->width, out->height);
+  if (out->frame_size <= 0)
+  {
+    r = Y4M_ERR_FORMAT;
+    goto cleanup;
+  }
+
+  // A truncated last frame is dropped
+  out->frame_count = (st.st_size - out->header_len) /
+                     (out->frame_header_len + out->frame_size);
+  if (out->frame_count <= 0 ||
+      !frame_marker_ok(fd, out, out->frame_count / 2) ||
+      !frame_marker_ok(fd, out, out->frame_count - 1))
+  {
+    r = Y4M_ERR_FORMAT;
+    goto cleanup;
+  }
+
+  out->path = strdup(path);
+  if (!out->path)
+    r = Y4M_ERR_NOMEM;
+
+cleanup:
+  free(hdr);
+  close(fd);
+  if (r != Y4M_OK)
+    y4m_close(out);
+  return r;
+}
+
+// ---------------------------------------------------------
+// Arithmetic planning
+// ---------------------------------------------------------
+static double frame_time(const y4m_info *y, int64_t frame)
+{
+  return (double)frame * y->fps_den / y->fps_num;
+}
+
+static int64_t time_frame(const y4m_info *y, double t)
+{
+  return llround(t * y->fps_num / y->fps_den);
+}
+
+int y4m_plan(const y4m_info *y, sc_plan_config cfg, sc_chunk_plan *out)
+{
+  if (!y || !out || y->frame_count <= 0)
+    return SC_ERR_INVAL;
+  memset(out, 0, sizeof(*out));
+
+  const int64_t frames = y->frame_count;
+  const double duration = frame_time(y, frames);
+
+  double target = cfg.target_dur;
+  if (cfg.ideal_parallel > 0)
+    target = duration / cfg.ideal_parallel;
+  if (target <= 0.0)
+    target = 10.0;
+  double min_dur = cfg.min_dur > 0.0 ? cfg.min_dur : target * 0.5;
+  double max_dur = cfg.max_dur > 0.0 ? cfg.max_dur : target * 2.0;
+
+  int64_t n = llround(duration / target);
+  if (min_dur > 0.0 && n > (int64_t)(duration / min_dur))
+    n = (int64_t)(duration / min_dur);
+  if (max_dur > 0.0 && n < (int64_t)ceil(duration / max_dur - 1e-9))
+    n = (int64_t)ceil(duration / max_dur - 1e-9);
+  if (cfg.max_chunks > 0 && n > cfg.max_chunks)
+    n = cfg.max_chunks;
+  if (cfg.min_chunks > 0 && n < cfg.min_chunks)
+    n = cfg.min_chunks;
+  if (n > frames)
+    n = frames;
+  if (n < 1)
+    n = 1;
+  if (n > INT32_MAX)
+    return SC_ERR_INVAL;
+
+  out->chunks = calloc((size_t)n, sizeof(*out->chunks));
+  if (!out->chunks)
+    return SC_ERR_NOMEM;
+  out->count = (int)n;
+  out->capacity = (int)n;
+
+  for (int64_t i = 0; i < n; i++)
+  {
+    int64_t f0 = frames * i / n;
+    int64_t f1 = frames * (i + 1) / n;
+    sc_chunk *c = &out->chunks[i];
+    c->index = (int)i;
+    c->start = frame_time(y, f0);
+    c->end = frame_time(y, f1);
+    c->keyframe_count = (int)(f1 - f0 < INT32_MAX ? f1 - f0 : INT32_MAX);
+    c->quality_score = 1.0;
+  }
+  return SC_OK;
+}
+
+// ---------------------------------------------------------
+// Splitting: header copy + one byte range
+// ---------------------------------------------------------
+static int copy_range(int in, int out, int64_t off, int64_t len)
+{
+  int r = rangeio_copy(in, out, off, len, NULL);
+  if (r == RANGEIO_ERR_NOMEM)
+    return Y4M_ERR_NOMEM;
+  return r == RANGEIO_OK ? Y4M_OK : Y4M_ERR_IO;
+}
+
+int y4m_split_chunk(const y4m_info *y, const sc_chunk *chunk, const char *outpath)
+{
+  if (!y || !chunk || !outpath || !y->path)
+    return Y4M_ERR_FORMAT;
+
+  int64_t f0 = time_frame(y, chunk->start);
+  int64_t f1 = time_frame(y, chunk->end);
+  if (f0 < 0)
+    f0 = 0;
+  if (f1 > y->frame_count)
+    f1 = y->frame_count;
+  if (f1 <= f0)
+    return Y4M_ERR_FORMAT;
+
+  int in = open(y->path, O_RDONLY);
+  if (in < 0)
+    return Y4M_ERR_OPEN;
+  int out = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+  {
+    close(in);
+    return Y4M_ERR_OPEN;
+  }
+
+  const int64_t stride = y->frame_header_len + y->frame_size;
+  int r = copy_range(in, out, 0, y->header_len);
+  if (r == Y4M_OK)
+    r = copy_range(in, out, y->header_len + f0 * stride, (f1 - f0) * stride);
+
+  close(in);
+  if (close(out) != 0 && r == Y4M_OK)
+    r = Y4M_ERR_IO;
+  return r;
+}
+
+int y4m_split_all(const y4m_info *y, const sc_chunk_plan *plan, const char *outdir)
+{
+  if (!y || !plan || !outdir)
+    return Y4M_ERR_FORMAT;
+
+  char outpath[1024];
+  for (int i = 0; i < plan->count; i++)
+  {
+    const sc_chunk *c = &plan->chunks[i];
+    if (snprintf(outpath, sizeof(outpath), "%s/chunk_%04d.y4m",
+                 outdir, c->index) >= (int)sizeof(outpath))
+      return Y4M_ERR_OPEN;
+
+    fprintf(stderr, "[split] %s (%.3f → %.3f) [y4m]\n", outpath, c->start, c->end);
+    int r = y4m_split_chunk(y, c, outpath);
+    if (r != Y4M_OK)
+      return r;
+  }
+  return Y4M_OK;
+}
+
+void y4m_close(y4m_info *y)
+{
+  if (!y)
+    return;
+  free(y->path);
+  memset(y, 0, sizeof(*y));
+}
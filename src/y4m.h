@@ -0,0 +1,71 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#include "smartchunk.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Y4M fast path. Every frame of an uncompressed YUV4MPEG2 master has the
+ * same size, so the layout is known from the stream header and the file
+ * size alone:
+ *
+ *   [stream header "YUV4MPEG2 ...\n"]["FRAME\n"][frame] ... ["FRAME\n"][frame]
+ *
+ * Opening, planning and splitting are all O(1) in the frame count. Every
+ * frame is a valid cut, so chunks are exact frame ranges. A chunk is
+ * the stream header followed by its frames, copied with
+ * copy_file_range() where the kernel has it.
+ */
+
+enum
+{
+    Y4M_OK = 0,
+    Y4M_ERR_OPEN = -80,
+    Y4M_ERR_FORMAT = -81, /* not Y4M, or frames of varying layout */
+    Y4M_ERR_IO = -82,
+    Y4M_ERR_NOMEM = -83
+};
+
+typedef struct
+{
+    char *path;
+    int64_t header_len;       /* stream header incl. newline */
+    int64_t frame_header_len; /* "FRAME...\n" */
+    int64_t frame_size;       /* picture bytes */
+    int64_t frame_count;
+    int fps_num;
+    int fps_den;
+    int width;
+    int height;
+} y4m_info;
+
+/* True for a .y4m file name */
+int y4m_detect(const char *path);
+
+/* Parse the header and derive the frame layout from the file size. The
+   frame markers are spot-checked at the first, middle and last frame */
+int y4m_open(const char *path, y4m_info *out);
+
+/* Frame-aligned plan: chunk count from the target (or ideal_parallel),
+   clamped by min/max duration and min/max chunks. Frames are spread
+   evenly, so there is no tiny tail */
+int y4m_plan(const y4m_info *y, sc_plan_config cfg, sc_chunk_plan *out);
+
+/* Stream header + the frames in [chunk->start, chunk->end) */
+int y4m_split_chunk(const y4m_info *y, const sc_chunk *chunk, const char *outpath);
+
+/* Every chunk of the plan as <outdir>/chunk_NNNN.y4m */
+int y4m_split_all(const y4m_info *y, const sc_chunk_plan *plan, const char *outdir);
+
+void y4m_close(y4m_info *y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* Y4M_H */